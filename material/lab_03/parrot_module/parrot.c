@@ -6,16 +6,59 @@
 #include <linux/uaccess.h> /* copy_(to|from)_user */
 #include <linux/cdev.h> /* Needed for cdev */
 #include <linux/string.h> /* Needed for string manipulation */
+#include <linux/kref.h> /* Needed for the buffer reference counting */
+#include <linux/mutex.h> /* Needed for the writer lock */
+#include <linux/rcupdate.h> /* Needed for the buffer publication */
+#include <linux/mm.h> /* Needed for kvmalloc */
+#include <linux/moduleparam.h> /* Needed for the size limit */
 
 #include "parrot.h"
 
 #define MAJOR_NUM 97
 #define DEVICE_NAME "parrot"
 #define PERMISSIONS 777
+#define DEFAULT_MAX_SIZE (16 * 1024 * 1024)
 
-static char *global_buffer;
-static char *initial_buffer;
-static int buffer_size;
+// kvmalloc accepts any size, the values written are limited here instead
+static unsigned long max_size = DEFAULT_MAX_SIZE;
+module_param(max_size, ulong, 0644);
+MODULE_PARM_DESC(max_size, "Maximum number of bytes of a written value");
+
+/**
+ * struct parrot_initial - the value written, restored by PARROT_CMD_RESET
+ *
+ * @ref:  One reference per buffer derived from it.
+ * @size: Size of the value with its '\0'.
+ * @data: The value.
+ */
+struct parrot_initial {
+	struct kref ref;
+	size_t size;
+	char data[];
+};
+
+/**
+ * struct parrot_buffer - a value of the parrot, never modified once published
+ *
+ * @ref:     One reference for the publication, one per reader copying it.
+ * @rcu:     Frees the buffer once no reader can still find it.
+ * @size:    Size of the value with its '\0'.
+ * @initial: The value written, shared by all the buffers derived from it.
+ * @data:    The value.
+ */
+struct parrot_buffer {
+	struct kref ref;
+	struct rcu_head rcu;
+	size_t size;
+	struct parrot_initial *initial;
+	char data[];
+};
+
+// the current value, readers find it under RCU and writers swap it
+static struct parrot_buffer __rcu *current_buffer;
+
+// serializes the writers so that an ioctl transforms the latest value
+static DEFINE_MUTEX(writer_lock);
 
 // store the device number
 static dev_t dev_nbr;
@@ -24,24 +67,211 @@ static dev_t dev_nbr;
 static struct cdev c_device;
 
 static struct class *cls_device;
+
+// every byte of a word set to 0x01 or 0x80
+#define BYTES_ONES 0x0101010101010101ULL
+#define BYTES_HIGHS 0x8080808080808080ULL
+
+/**
+ * @brief Find the ASCII bytes of a word that are within a range.
+ *
+ * @param word The 8 bytes.
+ * @param low  First character of the range, below 0x80.
+ * @param high Last character of the range, below 0x80.
+ *
+ * @return 0x80 on each byte within the range, 0 on the others.
+ *
+ * The high bit of each byte is cleared before the additions so no carry
+ * crosses a byte, x + 0x80 - low has its high bit set if x >= low.
+ */
+static u64 bytes_in_range(u64 word, u8 low, u8 high)
+{
+	u64 ascii = ~word & BYTES_HIGHS;
+	u64 low7 = word & ~BYTES_HIGHS;
+	u64 above_low = low7 + BYTES_ONES * (0x80 - low);
+	u64 above_high = low7 + BYTES_ONES * (0x7f - high);
+
+	return ascii & above_low & ~above_high & BYTES_HIGHS;
+}
+
+/**
+ * @brief Swap the case of the letters of one character.
+ *
+ * @param c          The character.
+ * @param swap_lower Swap lower case letters to upper case.
+ * @param swap_upper Swap upper case letters to lower case.
+ *
+ * @return The character swapped or not.
+ */
+static char char_manip(char c, int swap_lower, int swap_upper)
+{
+	if (c >= 'a' && c <= 'z' && swap_lower) {
+		return c + ('A' - 'a');
+	} else if (c >= 'A' && c <= 'Z' && swap_upper) {
+		return c + ('a' - 'A');
+	}
+	return c;
+}
+
 /**
  * @brief String manipulation to put all char in upper/lower case or invert
  * them.
  *
- * @param str        String on which the manipulation are done.
+ * @param dst        Where the manipulated string is written.
+ * @param src        String on which the manipulation are done.
+ * @param len        Number of bytes of the string.
  * @param swap_lower Swap all lower case letters to upper case.
  * @param swap_upper Swap all upper case letters to lower case.
+ *
+ * The string is handled 8 bytes at a time without branches, the letters to
+ * swap get their case bit flipped, the last bytes are handled one by one.
+ * Copying while manipulating reads the value only once.
  */
-static void str_manip(char *str, int swap_lower, int swap_upper)
+static void str_manip(char *dst, const char *src, size_t len, int swap_lower,
+		      int swap_upper)
 {
-	while (*str != '\0') {
-		if (*str >= 'a' && *str <= 'z' && swap_lower) {
-			*str = *str + ('A' - 'a');
-		} else if (*str >= 'A' && *str <= 'Z' && swap_upper) {
-			*str = *str + ('a' - 'A');
+	u64 word, mask;
+
+	while (len >= sizeof(word)) {
+		// memcpy handles the unaligned words without a real copy
+		memcpy(&word, src, sizeof(word));
+		mask = 0;
+		if (swap_lower) {
+			mask |= bytes_in_range(word, 'a', 'z');
+		}
+		if (swap_upper) {
+			mask |= bytes_in_range(word, 'A', 'Z');
 		}
+		// 0x80 >> 2 is the case bit of each letter
+		word ^= mask >> 2;
+		memcpy(dst, &word, sizeof(word));
 
-		str++;
+		src += sizeof(word);
+		dst += sizeof(word);
+		len -= sizeof(word);
+	}
+
+	while (len > 0) {
+		*dst = char_manip(*src, swap_lower, swap_upper);
+		src++;
+		dst++;
+		len--;
+	}
+}
+
+/**
+ * @brief Allocate an initial value.
+ *
+ * @param size Size of the value with its '\0'.
+ *
+ * @return The initial value with one reference, NULL if out of memory.
+ */
+static struct parrot_initial *parrot_initial_alloc(size_t size)
+{
+	struct parrot_initial *initial;
+
+	// multi-megabyte values do not fit in kmalloc
+	initial = kvmalloc(struct_size(initial, data, size), GFP_KERNEL);
+	if (!initial) {
+		return NULL;
+	}
+
+	kref_init(&initial->ref);
+	initial->size = size;
+	return initial;
+}
+
+static void parrot_initial_release(struct kref *ref)
+{
+	kvfree(container_of(ref, struct parrot_initial, ref));
+}
+
+static void parrot_initial_put(struct parrot_initial *initial)
+{
+	kref_put(&initial->ref, parrot_initial_release);
+}
+
+/**
+ * @brief Allocate a buffer derived from an initial value.
+ *
+ * @param initial The initial value, the buffer takes over one of its
+ *                references, even on failure.
+ *
+ * @return The buffer with one reference, NULL if out of memory.
+ */
+static struct parrot_buffer *parrot_buffer_alloc(struct parrot_initial *initial)
+{
+	struct parrot_buffer *buffer;
+
+	buffer = kvmalloc(struct_size(buffer, data, initial->size),
+			  GFP_KERNEL);
+	if (!buffer) {
+		parrot_initial_put(initial);
+		return NULL;
+	}
+
+	kref_init(&buffer->ref);
+	buffer->size = initial->size;
+	buffer->initial = initial;
+	return buffer;
+}
+
+static void parrot_buffer_free(struct rcu_head *rcu)
+{
+	struct parrot_buffer *buffer =
+		container_of(rcu, struct parrot_buffer, rcu);
+
+	parrot_initial_put(buffer->initial);
+	kvfree(buffer);
+}
+
+static void parrot_buffer_release(struct kref *ref)
+{
+	struct parrot_buffer *buffer =
+		container_of(ref, struct parrot_buffer, ref);
+
+	// a reader may still be trying to take a reference
+	call_rcu(&buffer->rcu, parrot_buffer_free);
+}
+
+/**
+ * @brief Take a reference on the current buffer.
+ *
+ * @return The buffer, NULL if nothing has been written yet.
+ */
+static struct parrot_buffer *parrot_buffer_get(void)
+{
+	struct parrot_buffer *buffer;
+
+	rcu_read_lock();
+	buffer = rcu_dereference(current_buffer);
+	// the buffer may have been replaced and released meanwhile
+	if (buffer && !kref_get_unless_zero(&buffer->ref)) {
+		buffer = NULL;
+	}
+	rcu_read_unlock();
+
+	return buffer;
+}
+
+static void parrot_buffer_put(struct parrot_buffer *buffer)
+{
+	kref_put(&buffer->ref, parrot_buffer_release);
+}
+
+/**
+ * @brief Replace the current buffer, writer_lock must be held.
+ *
+ * @param buffer The new buffer, its reference is given to the publication.
+ */
+static void parrot_buffer_publish(struct parrot_buffer *buffer)
+{
+	struct parrot_buffer *old;
+
+	old = rcu_replace_pointer(current_buffer, buffer,
+				  lockdep_is_held(&writer_lock));
+	if (old != NULL) {
+		parrot_buffer_put(old);
 	}
 }
 
@@ -54,25 +284,41 @@ static void str_manip(char *str, int swap_lower, int swap_upper)
  * @param ppos  Current cursor position in the file (ignored).
  *
  * @return Number of bytes written in the userspace buffer.
+ *
+ * Readers never wait, they copy the buffer that was current when they
+ * started even if a writer replaces it during the copy.
  */
 static ssize_t parrot_read(struct file *filp, char __user *buf, size_t count,
 			   loff_t *ppos)
 {
-	if (buf == 0 || count < buffer_size) {
-		return 0;
-	}
+	struct parrot_buffer *buffer;
+	ssize_t ret;
+
 	// This a simple usage of ppos to avoid infinit loop with `cat`
 	// it may not be the correct way to do.
-	if (*ppos != 0) {
+	if (buf == 0 || *ppos != 0) {
 		return 0;
 	}
-	*ppos = buffer_size;
-	// check if the copy_to_user succeed and if the uncopied data is not 0
-	if (copy_to_user(buf, global_buffer, buffer_size)) {
-		return -EFAULT;
+
+	buffer = parrot_buffer_get();
+	if (buffer == NULL) {
+		return 0;
+	}
+
+	ret = 0;
+	if (count >= buffer->size) {
+		// check if the copy_to_user succeed and if the uncopied data
+		// is not 0
+		if (copy_to_user(buf, buffer->data, buffer->size)) {
+			ret = -EFAULT;
+		} else {
+			*ppos = buffer->size;
+			ret = buffer->size;
+		}
 	}
 
-	return buffer_size;
+	parrot_buffer_put(buffer);
+	return ret;
 }
 
 /**
@@ -83,60 +329,48 @@ static ssize_t parrot_read(struct file *filp, char __user *buf, size_t count,
  * @param count Number of available bytes in the userspace buffer.
  * @param ppos  Current cursor position in the file.
  *
- * @return Number of bytes read from the userspace buffer.
+ * @return Number of bytes read from the userspace buffer, -EFBIG if the value
+ *         is bigger than max_size.
  */
 
 static ssize_t parrot_write(struct file *filp, const char __user *buf,
 			    size_t count, loff_t *ppos)
 {
+	struct parrot_initial *initial;
+	struct parrot_buffer *buffer;
+
 	if (count == 0) {
 		return 0;
 	}
 
-	*ppos = 0;
-
-	// check if the buffer is already allocated
-	if (global_buffer != NULL) {
-		kfree(global_buffer);
-		global_buffer = NULL;
-	}
-
-	if (initial_buffer != NULL) {
-		kfree(initial_buffer);
-		initial_buffer = NULL;
+	if (count > READ_ONCE(max_size)) {
+		return -EFBIG;
 	}
 
-	global_buffer = kmalloc(count + 1, GFP_KERNEL);
-	initial_buffer = kmalloc(count + 1, GFP_KERNEL);
-
-	// be sure that the allocation succeed
-	if (!global_buffer) {
-		return -ENOMEM;
-	}
+	*ppos = 0;
 
-	// be sure that the allocation succeed
-	if (!initial_buffer) {
-		kfree(global_buffer);
-		global_buffer = NULL;
-		initial_buffer = NULL;
+	// the new value is prepared without blocking the other writers
+	initial = parrot_initial_alloc(count + 1);
+	if (!initial) {
 		return -ENOMEM;
 	}
 
 	// check if the copy_from_user succeed and if the uncopide data is not 0
-	if (copy_from_user(global_buffer, buf, count)) {
-		kfree(global_buffer);
-		kfree(initial_buffer);
-		global_buffer = NULL;
-		initial_buffer = NULL;
+	if (copy_from_user(initial->data, buf, count)) {
+		parrot_initial_put(initial);
 		return -EFAULT;
 	}
+	initial->data[count] = '\0';
 
-	// save the initial value
-	strcpy(initial_buffer, global_buffer);
-
-	global_buffer[count] = '\0';
+	buffer = parrot_buffer_alloc(initial);
+	if (!buffer) {
+		return -ENOMEM;
+	}
+	memcpy(buffer->data, initial->data, initial->size);
 
-	buffer_size = count + 1;
+	mutex_lock(&writer_lock);
+	parrot_buffer_publish(buffer);
+	mutex_unlock(&writer_lock);
 
 	return count;
 }
@@ -158,23 +392,26 @@ static ssize_t parrot_write(struct file *filp, const char __user *buf,
 static long parrot_ioctl(struct file *filep, unsigned int cmd,
 			 unsigned long arg)
 {
-	if (buffer_size == 0) {
-		return -1;
-	}
+	struct parrot_buffer *old, *buffer;
+	int swap_lower, swap_upper;
+	size_t len;
 
 	switch (cmd) {
 	case PARROT_CMD_TOGGLE:
-		str_manip(global_buffer, 1, 1);
+		swap_lower = 1;
+		swap_upper = 1;
 		break;
 
 	case PARROT_CMD_ALLCASE:
 		switch (arg) {
 		case TO_UPPERCASE:
-			str_manip(global_buffer, 1, 0);
+			swap_lower = 1;
+			swap_upper = 0;
 			break;
 
 		case TO_LOWERCASE:
-			str_manip(global_buffer, 0, 1);
+			swap_lower = 0;
+			swap_upper = 1;
 			break;
 
 		default:
@@ -183,13 +420,45 @@ static long parrot_ioctl(struct file *filep, unsigned int cmd,
 		break;
 
 	case PARROT_CMD_RESET:
-		// restore the initial value
-		strcpy(global_buffer, initial_buffer);
+		swap_lower = 0;
+		swap_upper = 0;
 		break;
 
 	default:
-		break;
+		return 0;
+	}
+
+	mutex_lock(&writer_lock);
+	old = rcu_dereference_protected(current_buffer,
+					lockdep_is_held(&writer_lock));
+	if (old == NULL) {
+		mutex_unlock(&writer_lock);
+		return -1;
+	}
+
+	// the readers may be copying the current buffer, it is transformed in
+	// a copy that replaces it, the initial value is only shared
+	kref_get(&old->initial->ref);
+	buffer = parrot_buffer_alloc(old->initial);
+	if (!buffer) {
+		mutex_unlock(&writer_lock);
+		return -ENOMEM;
+	}
+
+	if (cmd == PARROT_CMD_RESET) {
+		// restore the initial value
+		memcpy(buffer->data, old->initial->data, old->size);
+	} else {
+		// as a string the value ends at its first '\0', the bytes
+		// from there are copied unchanged
+		len = strnlen(old->data, old->size);
+		str_manip(buffer->data, old->data, len, swap_lower,
+			  swap_upper);
+		memcpy(buffer->data + len, old->data + len, old->size - len);
 	}
+
+	parrot_buffer_publish(buffer);
+	mutex_unlock(&writer_lock);
 	return 0;
 }
 
@@ -253,8 +522,6 @@ static int __init parrot_init(void)
 		return -1;
 	}
 
-	buffer_size = 0;
-
 	pr_info("Parrot ready!\n");
 	pr_info("ioctl PARROT_CMD_TOGGLE: %u\n", PARROT_CMD_TOGGLE);
 	pr_info("ioctl PARROT_CMD_ALLCASE: %lu\n", PARROT_CMD_ALLCASE);
@@ -264,10 +531,8 @@ static int __init parrot_init(void)
 
 static void __exit parrot_exit(void)
 {
-	if (global_buffer != NULL) {
-		kfree(global_buffer);
-		global_buffer = NULL;
-	}
+	struct parrot_buffer *buffer;
+
 	// remove the device
 	device_destroy(cls_device, dev_nbr);
 
@@ -278,6 +543,13 @@ static void __exit parrot_exit(void)
 	cdev_del(&c_device);
 	unregister_chrdev_region(dev_nbr, 1);
 
+	// nobody can use the device anymore
+	buffer = rcu_replace_pointer(current_buffer, NULL, true);
+	if (buffer != NULL) {
+		parrot_buffer_put(buffer);
+	}
+	rcu_barrier();
+
 	pr_info("Parrot done!\n");
 }
 
@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+
+#include "parrot.h"
+
+#define DEFAULT_DEVICE "/dev/parrot"
+#define DEFAULT_SIZE_MB 8
+#define DEFAULT_ITERATIONS 50
+#define MB (1024 * 1024)
+// values of every size up to this one are checked
+#define CHECK_MAX_SMALL 40
+
+/* Mixed text with letters of both cases, digits and bytes above 0x7f */
+static void fill_text(char *text, size_t size)
+{
+	static const char chars[] = "abcdefghijklmnopqrstuvwxyz"
+				    "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+				    "0123456789 .,;:!?@[]`{}\xc3\xa9";
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		text[i] = chars[rand() % (sizeof(chars) - 1)];
+	}
+}
+
+static double elapsed_since(const struct timespec *start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) +
+	       (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Time one ioctl repeated on the whole value, in seconds per call */
+static double bench(int fd, unsigned long cmd, unsigned long arg,
+		    unsigned int iterations)
+{
+	struct timespec start;
+	unsigned int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < iterations; i++) {
+		if (ioctl(fd, cmd, arg) < 0) {
+			perror("ioctl");
+			return -1;
+		}
+	}
+	return elapsed_since(&start) / iterations;
+}
+
+static void report(const char *name, double call, double reset, size_t size)
+{
+	printf("%-10s %8.1f us/call %8.1f MB/s", name, call * 1e6,
+	       size / call / MB);
+	// a reset only copies and publishes, what is left is the transform
+	if (reset > 0 && call > reset) {
+		printf(" %8.1f us/call %8.1f MB/s", (call - reset) * 1e6,
+		       size / (call - reset) / MB);
+	}
+	printf("\n");
+}
+
+static int toggle(int c)
+{
+	return islower(c) ? toupper(c) : isupper(c) ? tolower(c) : c;
+}
+
+static int to_upper(int c)
+{
+	return islower(c) ? toupper(c) : c;
+}
+
+static int to_lower(int c)
+{
+	return isupper(c) ? tolower(c) : c;
+}
+
+/* Read the value back and compare it to the reference, '\0' included */
+static int check(int fd, const char *expected, size_t size, char *value)
+{
+	size_t i;
+
+	// the value is read from the start whatever the position of the file
+	if (pread(fd, value, size + 1, 0) != (ssize_t)(size + 1)) {
+		perror("read");
+		return -1;
+	}
+	for (i = 0; i <= size; i++) {
+		if (value[i] != expected[i]) {
+			printf("Byte %zu of %zu is 0x%02x, expected 0x%02x\n", i,
+			       size, (unsigned char)value[i],
+			       (unsigned char)expected[i]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Apply one ioctl to the driver and its byte per byte reference */
+static int check_cmd(int fd, unsigned long cmd, unsigned long arg,
+		     int (*transform)(int), char *expected, size_t size,
+		     char *value)
+{
+	size_t i;
+
+	if (ioctl(fd, cmd, arg) < 0) {
+		perror("ioctl");
+		return -1;
+	}
+	// the value is a string, it ends at its first '\0'
+	for (i = 0; i < size && expected[i] != '\0'; i++) {
+		expected[i] = transform((unsigned char)expected[i]);
+	}
+	return check(fd, expected, size, value);
+}
+
+/* Every command on a value, the text starting at any offset */
+static int check_value(int fd, const char *text, size_t size, char *expected,
+		       char *value)
+{
+	if (write(fd, text, size) != (ssize_t)size) {
+		perror("write");
+		return -1;
+	}
+	memcpy(expected, text, size);
+	expected[size] = '\0';
+
+	if (check(fd, expected, size, value) < 0 ||
+	    check_cmd(fd, PARROT_CMD_TOGGLE, 0, toggle, expected, size,
+		      value) < 0 ||
+	    check_cmd(fd, PARROT_CMD_ALLCASE, TO_UPPERCASE, to_upper, expected,
+		      size, value) < 0 ||
+	    check_cmd(fd, PARROT_CMD_TOGGLE, 0, toggle, expected, size,
+		      value) < 0 ||
+	    check_cmd(fd, PARROT_CMD_ALLCASE, TO_LOWERCASE, to_lower, expected,
+		      size, value) < 0) {
+		return -1;
+	}
+
+	// the reset goes back to the text whatever was done since
+	if (ioctl(fd, PARROT_CMD_RESET, 0) < 0) {
+		perror("ioctl");
+		return -1;
+	}
+	memcpy(expected, text, size);
+	return check(fd, expected, size, value);
+}
+
+/* Sizes around the words, so that the last bytes are handled one by one */
+static int check_all(int fd, const char *text, size_t size, char *expected,
+		     char *value)
+{
+	char with_nul[CHECK_MAX_SMALL];
+	size_t len, offset;
+
+	// the bytes after an embedded '\0' are left as they were written
+	memcpy(with_nul, text, sizeof(with_nul));
+	with_nul[sizeof(with_nul) / 2] = '\0';
+	if (check_value(fd, with_nul, sizeof(with_nul), expected, value) < 0) {
+		return -1;
+	}
+
+	for (len = 1; len <= CHECK_MAX_SMALL; len++) {
+		for (offset = 0; offset < 8; offset++) {
+			if (check_value(fd, text + offset, len, expected,
+					value) < 0) {
+				return -1;
+			}
+		}
+	}
+	for (len = size - 8; len < size; len++) {
+		if (check_value(fd, text + size - len, len, expected,
+				value) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *device = DEFAULT_DEVICE;
+	size_t size = DEFAULT_SIZE_MB * MB;
+	unsigned int iterations = DEFAULT_ITERATIONS;
+	double reset, toggle_call, upper_call, lower_call;
+	char *text, *expected, *value;
+	int fd;
+
+	if (argc > 4) {
+		printf("Usage: %s [device] [size MB] [iterations]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (argc > 1) {
+		device = argv[1];
+	}
+	if (argc > 2) {
+		size = strtoul(argv[2], NULL, 10) * MB;
+	}
+	if (argc > 3) {
+		iterations = strtoul(argv[3], NULL, 10);
+	}
+	if (size == 0 || iterations == 0) {
+		printf("Invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	text = malloc(size);
+	expected = malloc(size + 1);
+	value = malloc(size + 1);
+	if (!text || !expected || !value) {
+		printf("Out of memory\n");
+		return EXIT_FAILURE;
+	}
+	fill_text(text, size);
+
+	fd = open(device, O_RDWR);
+	if (fd < 0) {
+		perror("parrot_bench");
+		return EXIT_FAILURE;
+	}
+
+	// the results are checked before anything is timed
+	if (check_all(fd, text, size, expected, value) < 0) {
+		printf("Check failed\n");
+		return EXIT_FAILURE;
+	}
+
+	if (write(fd, text, size) != (ssize_t)size) {
+		perror("write");
+		return EXIT_FAILURE;
+	}
+	printf("%zu MB, %u calls per command\n", size / MB, iterations);
+	reset = bench(fd, PARROT_CMD_RESET, 0, iterations);
+	toggle_call = bench(fd, PARROT_CMD_TOGGLE, 0, iterations);
+	upper_call = bench(fd, PARROT_CMD_ALLCASE, TO_UPPERCASE, iterations);
+	lower_call = bench(fd, PARROT_CMD_ALLCASE, TO_LOWERCASE, iterations);
+	if (reset < 0 || toggle_call < 0 || upper_call < 0 || lower_call < 0) {
+		printf("Benchmark failed\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("%-10s %30s %30s\n", "", "whole ioctl", "minus the reset");
+	report("reset", reset, 0, size);
+	report("toggle", toggle_call, reset, size);
+	report("uppercase", upper_call, reset, size);
+	report("lowercase", lower_call, reset, size);
+
+	printf("Benchmark run successfully!\n");
+	free(text);
+	free(expected);
+	free(value);
+	close(fd);
+	return EXIT_SUCCESS;
+}
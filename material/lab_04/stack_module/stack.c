@@ -11,32 +11,569 @@
 #include <linux/uaccess.h>
 #include <linux/cdev.h>
 #include <linux/device.h>
-#include <linux/list.h>
 #include <linux/string.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/mempool.h>
+#include <linux/moduleparam.h>
+#include <linux/poll.h>
+#include <linux/sched.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+#include "stack_mmap.h"
 
-#define MAJOR_NUM 98
-#define MAJMIN MKDEV(MAJOR_NUM, 0)
 #define DEVICE_NAME "stack"
+#define MAX_STACKS 64
 
+static dev_t first_dev;
 static struct cdev cdev;
 static struct class *cl;
 
-static LIST_HEAD(stack);
+// each minor is its own stack: /dev/stack, then /dev/stack1, /dev/stack2...
+static unsigned int nb_stacks = 1;
+module_param(nb_stacks, uint, 0444);
+MODULE_PARM_DESC(nb_stacks, "Number of independent stacks");
+
+#define VALUES_PER_CHUNK (PAGE_SIZE / sizeof(uint32_t))
+#define MIN_CHUNKS_CAPACITY 8
+#define RESERVED_CHUNKS 4
+#define DEFAULT_MAX_VALUES (1024 * 1024)
+
+static int max_values_set(const char *val, const struct kernel_param *kp);
 
-struct element {
-	int data;
-	struct list_head list;
+static const struct kernel_param_ops max_values_ops = {
+	.set = max_values_set,
+	.get = param_get_ulong,
 };
 
-static int get_stack_size(void)
+static unsigned long max_values = DEFAULT_MAX_VALUES;
+module_param_cb(max_values, &max_values_ops, &max_values, 0644);
+MODULE_PARM_DESC(max_values, "Maximum number of values in the stack");
+
+static bool block_when_full = true;
+module_param(block_when_full, bool, 0644);
+MODULE_PARM_DESC(block_when_full,
+		 "Block the writers of a full stack instead of -ENOSPC");
+
+// the chunks are whole pages so that they can be mapped in user space, a few
+// are kept in reserve so that a push never waits on the page allocator when
+// memory is tight
+static mempool_t *chunk_pool;
+
+/**
+ * struct stack - values stored in pages, one page is a chunk
+ *
+ * @lock: serializes the pushes and the pops, the copies from and to the user
+ *        are done with it held so it is a mutex
+ * @chunks: the pages, chunk i holds the values i * VALUES_PER_CHUNK and up
+ * @nb_chunks: number of pages allocated
+ * @chunks_lock: protects chunks, nb_chunks and nb_mappings for the mappings,
+ *               which cannot take the mutex: mmap and the page faults run
+ *               with the mmap lock held, while a push holding the mutex may
+ *               fault and take the mmap lock
+ * @chunks_capacity: number of entries of the chunks array
+ * @size: number of values in the stack, the top is at index size - 1, it is
+ *        only written with the lock held but can be read without it
+ * @peak: biggest size reached
+ * @nb_full: number of pushes that found the stack full
+ * @space_wait: writers waiting for the stack to have room, woken by pops
+ * @data_wait: readers waiting for values, woken by pushes
+ * @header: first page of the mappings, updated with the lock held
+ * @nb_mappings: number of mappings, the chunks are only freed once the last
+ *               one is closed
+ */
+struct stack {
+	struct mutex lock;
+	uint32_t **chunks;
+	size_t nb_chunks;
+	spinlock_t chunks_lock;
+	size_t chunks_capacity;
+	size_t size;
+	size_t peak;
+	unsigned long nb_full;
+	wait_queue_head_t space_wait;
+	wait_queue_head_t data_wait;
+	struct stack_header *header;
+	unsigned int nb_mappings;
+};
+
+/**
+ * struct stack_file - state of an opened /dev/stack
+ *
+ * @stack: the stack used by the file
+ * @nb_pushed: values pushed through this file
+ * @nb_popped: values popped through this file
+ */
+struct stack_file {
+	struct stack *stack;
+	size_t nb_pushed;
+	size_t nb_popped;
+};
+
+static struct stack *stacks;
+
+static size_t get_stack_size(struct stack *stack)
+{
+	return READ_ONCE(stack->size);
+}
+
+/**
+ * @brief Get the number of values that can still be pushed
+ *
+ * @param stack the stack
+ *
+ * @return the room left before max_values
+ */
+static size_t get_stack_room(struct stack *stack)
+{
+	unsigned long capacity = READ_ONCE(max_values);
+	size_t size = get_stack_size(stack);
+
+	return capacity > size ? capacity - size : 0;
+}
+
+static int max_values_set(const char *val, const struct kernel_param *kp)
+{
+	unsigned int i;
+	int err;
+
+	err = param_set_ulong(val, kp);
+	// the parameter is also set when the module is loaded, before the
+	// stacks exist
+	if (!err && stacks)
+		for (i = 0; i < nb_stacks; i++)
+			wake_up_interruptible(&stacks[i].space_wait);
+	return err;
+}
+
+/**
+ * @brief Get the address of a value of the stack
+ *
+ * @param stack the stack
+ * @param index index of the value, 0 is the bottom of the stack
+ *
+ * @return the address of the value in its chunk
+ */
+static uint32_t *stack_value(struct stack *stack, size_t index)
+{
+	return &stack->chunks[index / VALUES_PER_CHUNK]
+			     [index % VALUES_PER_CHUNK];
+}
+
+/**
+ * @brief Allocate the chunks needed to hold nb_values more values, the lock
+ *        must be held
+ *
+ * @param stack the stack
+ * @param nb_values number of values about to be pushed
+ *
+ * @return 0 or -ENOMEM, the values of the stack are left unchanged on error
+ */
+static int stack_reserve(struct stack *stack, size_t nb_values)
+{
+	size_t needed, capacity;
+	uint32_t **chunks, **old;
+	struct page *page;
+
+	if (nb_values > SIZE_MAX - stack->size)
+		return -ENOMEM;
+	needed = DIV_ROUND_UP(stack->size + nb_values, VALUES_PER_CHUNK);
+
+	if (needed > stack->chunks_capacity) {
+		capacity = max_t(size_t, stack->chunks_capacity * 2,
+				 MIN_CHUNKS_CAPACITY);
+		capacity = max(capacity, needed);
+		chunks = kmalloc_array(capacity, sizeof(*chunks), GFP_KERNEL);
+		if (!chunks)
+			return -ENOMEM;
+		memcpy(chunks, stack->chunks,
+		       stack->nb_chunks * sizeof(*chunks));
+
+		// a fault may be reading the old array
+		spin_lock(&stack->chunks_lock);
+		old = stack->chunks;
+		stack->chunks = chunks;
+		spin_unlock(&stack->chunks_lock);
+		kfree(old);
+		stack->chunks_capacity = capacity;
+	}
+
+	// the chunks allocated before a failure are kept for the next push
+	while (stack->nb_chunks < needed) {
+		page = mempool_alloc(chunk_pool, GFP_KERNEL);
+		if (!page)
+			return -ENOMEM;
+		// the whole page is mapped, it must not show older data
+		clear_page(page_address(page));
+		spin_lock(&stack->chunks_lock);
+		stack->chunks[stack->nb_chunks] = page_address(page);
+		stack->nb_chunks++;
+		spin_unlock(&stack->chunks_lock);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Free the chunks left empty by a pop, the lock must be held
+ *
+ * One empty chunk is kept so that pushing and popping around a chunk
+ * boundary does not allocate and free a page each time.
+ *
+ * @param stack the stack
+ */
+static void stack_shrink(struct stack *stack)
+{
+	size_t used = DIV_ROUND_UP(stack->size, VALUES_PER_CHUNK);
+	uint32_t *chunk;
+
+	while (stack->nb_chunks > used + 1) {
+		// a mapped chunk must stay the one seen by the user, a chunk
+		// removed here cannot be faulted in by a new mapping anymore
+		spin_lock(&stack->chunks_lock);
+		if (stack->nb_mappings > 0) {
+			spin_unlock(&stack->chunks_lock);
+			return;
+		}
+		stack->nb_chunks--;
+		chunk = stack->chunks[stack->nb_chunks];
+		spin_unlock(&stack->chunks_lock);
+
+		clear_page(chunk);
+		mempool_free(virt_to_page(chunk), chunk_pool);
+	}
+}
+
+/**
+ * @brief Tell the mappings that the stack is being modified, the lock must
+ *        be held
+ *
+ * @param stack the stack
+ */
+static void stack_begin_update(struct stack *stack)
+{
+	WRITE_ONCE(stack->header->generation, stack->header->generation + 1);
+	smp_wmb();
+}
+
+/**
+ * @brief Publish the new size to the mappings, the lock must be held
+ *
+ * @param stack the stack
+ */
+static void stack_end_update(struct stack *stack)
+{
+	WRITE_ONCE(stack->header->size, stack->size);
+	smp_wmb();
+	WRITE_ONCE(stack->header->generation, stack->header->generation + 1);
+}
+
+/**
+ * @brief Remove the values on top of the stack, the lock must be held
+ *
+ * @param stack the stack
+ * @param nb_values number of values, at most the size of the stack
+ */
+static void stack_drop(struct stack *stack, size_t nb_values)
+{
+	size_t index = stack->size - nb_values;
+	size_t len;
+
+	// the values popped must not be seen by the mappings
+	while (index < stack->size) {
+		len = min_t(size_t, stack->size - index,
+			    VALUES_PER_CHUNK - index % VALUES_PER_CHUNK);
+		memset(stack_value(stack, index), 0, len * sizeof(uint32_t));
+		index += len;
+	}
+
+	WRITE_ONCE(stack->size, stack->size - nb_values);
+	stack_shrink(stack);
+	if (nb_values > 0)
+		wake_up_interruptible(&stack->space_wait);
+}
+
+/**
+ * @brief Push values copied straight from the user into the chunks,
+ *        buf[0] first so the last one ends on top, the lock must be held
+ *
+ * @param stack the stack
+ * @param buf the values in user space
+ * @param nb_values number of values
+ *
+ * @return the number of values pushed, -ENOMEM or -EFAULT if none
+ */
+static ssize_t stack_push_from_user(struct stack *stack,
+				    const uint32_t __user *buf,
+				    size_t nb_values)
+{
+	size_t offset, len, pushed = 0;
+	int err;
+
+	err = stack_reserve(stack, nb_values);
+	if (err)
+		return err;
+
+	// one copy per chunk, no intermediate buffer
+	while (pushed < nb_values) {
+		offset = stack->size % VALUES_PER_CHUNK;
+		len = min_t(size_t, nb_values - pushed,
+			    VALUES_PER_CHUNK - offset);
+		if (copy_from_user(stack_value(stack, stack->size),
+				   buf + pushed, len * sizeof(uint32_t)) != 0)
+			break;
+		WRITE_ONCE(stack->size, stack->size + len);
+		pushed += len;
+	}
+	stack->peak = max(stack->peak, stack->size);
+	if (pushed > 0)
+		wake_up_interruptible(&stack->data_wait);
+
+	return pushed > 0 || nb_values == 0 ? pushed : -EFAULT;
+}
+
+/**
+ * @brief Reverse values in place
+ *
+ * @param values the values
+ * @param nb_values number of values
+ */
+static void reverse_values(uint32_t *values, size_t nb_values)
+{
+	size_t i;
+
+	for (i = 0; i < nb_values / 2; i++)
+		swap(values[i], values[nb_values - 1 - i]);
+}
+
+/**
+ * @brief Pop values copied straight from the chunks to the user, the top of
+ *        the stack first, the lock must be held
+ *
+ * The values of a chunk are reversed in place before being copied since they
+ * are about to leave the stack, they are put back in order if the copy fails.
+ *
+ * @param stack the stack
+ * @param buf destination of the values in user space
+ * @param nb_values number of values, at most the size of the stack
+ *
+ * @return the number of values popped, -EFAULT if none
+ */
+static ssize_t stack_pop_to_user(struct stack *stack, uint32_t __user *buf,
+				 size_t nb_values)
+{
+	size_t end, len, popped = 0;
+	uint32_t *first;
+
+	// one copy per chunk, from the top chunk down
+	while (popped < nb_values) {
+		end = stack->size - popped;
+		len = min_t(size_t, nb_values - popped,
+			    (end - 1) % VALUES_PER_CHUNK + 1);
+		first = stack_value(stack, end - len);
+		reverse_values(first, len);
+		if (copy_to_user(buf + popped, first,
+				 len * sizeof(uint32_t)) != 0) {
+			reverse_values(first, len);
+			break;
+		}
+		popped += len;
+	}
+
+	stack_drop(stack, popped);
+	return popped > 0 ? popped : -EFAULT;
+}
+
+/**
+ * @brief Push a single value already read from the user, the lock must be
+ *        held
+ *
+ * @param stack the stack
+ * @param value the value
+ *
+ * @return 1 or -ENOMEM
+ */
+static ssize_t stack_push_value(struct stack *stack, uint32_t value)
+{
+	int err;
+
+	err = stack_reserve(stack, 1);
+	if (err)
+		return err;
+
+	*stack_value(stack, stack->size) = value;
+	WRITE_ONCE(stack->size, stack->size + 1);
+	stack->peak = max(stack->peak, stack->size);
+	wake_up_interruptible(&stack->data_wait);
+	return 1;
+}
+
+/**
+ * @brief Take the lock once the stack has room for at least one value
+ *
+ * @param stack the stack
+ * @param filp the file pushing, O_NONBLOCK is honoured
+ *
+ * @return the room with the lock held, or a negative error code without it:
+ *         -ENOSPC if block_when_full is not set, -EAGAIN or -ERESTARTSYS
+ */
+static ssize_t stack_lock_room(struct stack *stack, struct file *filp)
+{
+	size_t room;
+
+	for (;;) {
+		mutex_lock(&stack->lock);
+		room = get_stack_room(stack);
+		if (room > 0)
+			return room;
+		stack->nb_full++;
+		mutex_unlock(&stack->lock);
+
+		if (!READ_ONCE(block_when_full))
+			return -ENOSPC;
+		if (filp->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		if (wait_event_interruptible(stack->space_wait,
+					     get_stack_room(stack) > 0))
+			return -ERESTARTSYS;
+	}
+}
+
+/**
+ * @brief Take the lock once the stack holds at least one value
+ *
+ * @param stack the stack
+ * @param filp the file popping, O_NONBLOCK is honoured
+ *
+ * @return the size with the lock held, or -EAGAIN or -ERESTARTSYS without it
+ */
+static ssize_t stack_lock_values(struct stack *stack, struct file *filp)
+{
+	size_t size;
+
+	for (;;) {
+		// an empty stack is seen without taking the lock
+		if (get_stack_size(stack) > 0) {
+			mutex_lock(&stack->lock);
+			size = stack->size;
+			if (size > 0)
+				return size;
+			mutex_unlock(&stack->lock);
+		}
+
+		if (filp->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		if (wait_event_interruptible(stack->data_wait,
+					     get_stack_size(stack) > 0))
+			return -ERESTARTSYS;
+	}
+}
+
+/**
+ * @brief Pop a single value, the value is only removed once it reached the
+ *        user, the lock must be held and the stack not empty
+ *
+ * @param stack the stack
+ * @param buf destination of the value in user space
+ *
+ * @return 1 or -EFAULT
+ */
+static ssize_t stack_pop_one(struct stack *stack, uint32_t __user *buf)
+{
+	if (put_user(*stack_value(stack, stack->size - 1), buf))
+		return -EFAULT;
+
+	stack_drop(stack, 1);
+	return 1;
+}
+
+/**
+ * @brief Initialize an empty stack
+ *
+ * @param stack the stack
+ *
+ * @return 0 or -ENOMEM
+ */
+static int init_stack(struct stack *stack)
+{
+	stack->header = (struct stack_header *)get_zeroed_page(GFP_KERNEL);
+	if (!stack->header)
+		return -ENOMEM;
+	stack->header->values_per_chunk = VALUES_PER_CHUNK;
+	stack->nb_mappings = 0;
+
+	mutex_init(&stack->lock);
+	spin_lock_init(&stack->chunks_lock);
+	init_waitqueue_head(&stack->space_wait);
+	init_waitqueue_head(&stack->data_wait);
+	stack->chunks = NULL;
+	stack->nb_chunks = 0;
+	stack->chunks_capacity = 0;
+	stack->size = 0;
+	stack->peak = 0;
+	stack->nb_full = 0;
+	return 0;
+}
+
+/**
+ * @brief Free the values of a stack, nobody must use it anymore
+ *
+ * @param stack the stack
+ */
+static void free_stack(struct stack *stack)
+{
+	while (stack->nb_chunks > 0) {
+		stack->nb_chunks--;
+		clear_page(stack->chunks[stack->nb_chunks]);
+		mempool_free(virt_to_page(stack->chunks[stack->nb_chunks]),
+			     chunk_pool);
+	}
+	kfree(stack->chunks);
+	stack->chunks = NULL;
+	stack->chunks_capacity = 0;
+	stack->size = 0;
+	free_page((unsigned long)stack->header);
+	stack->header = NULL;
+}
+
+/**
+ * @brief Open the stack of the minor, each open file gets its own handle
+ *
+ * @param inode the inode of the device
+ * @param filp the file
+ *
+ * @return 0 or -ENOMEM
+ */
+static int stack_open(struct inode *inode, struct file *filp)
 {
-	int size = 0;
-	struct element *element;
+	struct stack_file *sfile;
 
-	list_for_each_entry(element, &stack, list)
-		size++;
+	sfile = kzalloc(sizeof(*sfile), GFP_KERNEL);
+	if (!sfile)
+		return -ENOMEM;
 
-	return size;
+	sfile->stack = &stacks[iminor(inode)];
+	filp->private_data = sfile;
+	return 0;
+}
+
+/**
+ * @brief Release the handle of a file
+ *
+ * @param inode the inode of the device
+ * @param filp the file
+ *
+ * @return 0
+ */
+static int stack_release(struct inode *inode, struct file *filp)
+{
+	struct stack_file *sfile = filp->private_data;
+
+	pr_debug("Stack: file closed after %zu pushes and %zu pops\n",
+		 sfile->nb_pushed, sfile->nb_popped);
+	kfree(sfile);
+	return 0;
 }
 
 /**
@@ -49,49 +586,56 @@ static int get_stack_size(void)
  *
  * @return Actual number of bytes read from internal buffer,
  *         or a negative error code
+ *
+ * An empty stack blocks the reader until a value is pushed, or returns
+ * -EAGAIN if the file is non-blocking.
  */
 static ssize_t stack_read(struct file *filp, char __user *buf, size_t count,
 			  loff_t *ppos)
 {
-	ssize_t nb_values, stack_size, i;
-	uint32_t *read_values;
-	struct element *element;
-	pr_info("Stack: Reading %d bytes\n", count);
+	struct stack_file *sfile = filp->private_data;
+	struct stack *stack = sfile->stack;
+	ssize_t nb_values, stack_size;
+
+	pr_debug("Stack: Reading %zu bytes\n", count);
 	if (count % sizeof(uint32_t) != 0) {
 		return -EINVAL;
 	}
 
 	nb_values = count / sizeof(uint32_t);
-	stack_size = get_stack_size();
-
-	if (stack_size == 0) {
-		printk("Stack: Stack is empty\n");
+	if (nb_values == 0) {
 		return 0;
 	}
 
-	// Check the current stack size and the number of values requested
-	if (nb_values > stack_size) {
-		nb_values = stack_size;
+	stack_size = stack_lock_values(stack, filp);
+	if (stack_size < 0) {
+		return stack_size;
 	}
 
-	read_values = kmalloc(nb_values * sizeof(uint32_t), GFP_KERNEL);
-	if (!read_values)
-		return -ENOMEM;
-
-	for (i = 0; i < nb_values; i++) {
-		element = list_first_entry(&stack, struct element, list);
-		read_values[i] = element->data;
-		list_del(&element->list);
-		kfree(element);
+	// the values are reversed in place while they are copied
+	stack_begin_update(stack);
+	if (nb_values == 1) {
+		nb_values = stack_pop_one(stack, (uint32_t __user *)buf);
+	} else {
+		// Check the current stack size and the number of values
+		// requested
+		if (nb_values > stack_size) {
+			nb_values = stack_size;
+		}
+
+		// the values are only removed once they reached the user
+		nb_values = stack_pop_to_user(stack, (uint32_t __user *)buf,
+					      nb_values);
 	}
+	stack_end_update(stack);
+	mutex_unlock(&stack->lock);
 
-	if (copy_to_user(buf, read_values, nb_values * sizeof(uint32_t)) != 0) {
-		kfree(read_values);
+	if (nb_values < 0) {
 		pr_err("Stack: Failed to copy data to user\n");
-		return -EFAULT;
+		return nb_values;
 	}
-	kfree(read_values);
 
+	sfile->nb_popped += nb_values;
 	return nb_values * sizeof(uint32_t);
 }
 
@@ -110,38 +654,103 @@ static ssize_t stack_write(struct file *filp, const char __user *buf,
 			   size_t count, loff_t *ppos)
 
 {
-	ssize_t nb_values;
-	uint32_t *new_values;
-	struct element *elements;
-	ssize_t i;
+	struct stack_file *sfile = filp->private_data;
+	struct stack *stack = sfile->stack;
+	ssize_t nb_values, room;
+	uint32_t value;
 
 	if (count % sizeof(uint32_t) != 0)
 		return -EINVAL;
+	if (count == 0)
+		return 0;
 
-	nb_values = count / sizeof(uint32_t);
-	new_values = kmalloc(count, GFP_KERNEL);
-
-	if (!new_values)
-		return -ENOMEM;
-
-	if (copy_from_user(new_values, buf, count) != 0) {
-		kfree(new_values);
-		pr_err("Stack: Failed to copy buffer from user\n");
+	// a single value is read before the lock so the critical section
+	// never faults
+	if (count == sizeof(uint32_t) &&
+	    get_user(value, (const uint32_t __user *)buf))
 		return -EFAULT;
+
+	// only the values that fit are pushed
+	room = stack_lock_room(stack, filp);
+	if (room < 0)
+		return room;
+
+	stack_begin_update(stack);
+	if (count == sizeof(uint32_t)) {
+		nb_values = stack_push_value(stack, value);
+	} else {
+		nb_values = stack_push_from_user(
+			stack, (const uint32_t __user *)buf,
+			min_t(size_t, count / sizeof(uint32_t), room));
 	}
-	elements = kmalloc_array(nb_values, sizeof(struct element), GFP_KERNEL);
-	if (!elements) {
-		kfree(new_values);
-		pr_err("Stack: Failed to allocate memory for stack elements\n");
-		return -ENOMEM;
-	}
-	for (i = 0; i < nb_values; i++) {
-		elements[i].data = new_values[i];
-		list_add(&elements[i].list, &stack);
+	stack_end_update(stack);
+	mutex_unlock(&stack->lock);
+
+	if (nb_values < 0) {
+		pr_err("Stack: Failed to push the values from user\n");
+		return nb_values;
 	}
-	kfree(new_values);
-	return count;
+
+	sfile->nb_pushed += nb_values;
+	return nb_values * sizeof(uint32_t);
+}
+
+static ssize_t size_show(struct device *dev, struct device_attribute *attr,
+			 char *buf)
+{
+	struct stack *stack = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%zu\n", get_stack_size(stack));
 }
+static DEVICE_ATTR_RO(size);
+
+static ssize_t peak_show(struct device *dev, struct device_attribute *attr,
+			 char *buf)
+{
+	struct stack *stack = dev_get_drvdata(dev);
+	size_t peak;
+
+	mutex_lock(&stack->lock);
+	peak = stack->peak;
+	mutex_unlock(&stack->lock);
+	return sprintf(buf, "%zu\n", peak);
+}
+static DEVICE_ATTR_RO(peak);
+
+static ssize_t memory_show(struct device *dev, struct device_attribute *attr,
+			   char *buf)
+{
+	struct stack *stack = dev_get_drvdata(dev);
+	size_t nb_chunks;
+
+	mutex_lock(&stack->lock);
+	nb_chunks = stack->nb_chunks;
+	mutex_unlock(&stack->lock);
+	return sprintf(buf, "%zu\n", nb_chunks * PAGE_SIZE);
+}
+static DEVICE_ATTR_RO(memory);
+
+static ssize_t full_count_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct stack *stack = dev_get_drvdata(dev);
+	unsigned long nb_full;
+
+	mutex_lock(&stack->lock);
+	nb_full = stack->nb_full;
+	mutex_unlock(&stack->lock);
+	return sprintf(buf, "%lu\n", nb_full);
+}
+static DEVICE_ATTR_RO(full_count);
+
+static struct attribute *stack_attrs[] = {
+	&dev_attr_size.attr,
+	&dev_attr_peak.attr,
+	&dev_attr_memory.attr,
+	&dev_attr_full_count.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(stack);
 
 /**
  * @brief uevent callback to set the permission on the device file
@@ -156,67 +765,225 @@ static int stack_uevent(struct device *dev, struct kobj_uevent_env *env)
 	return 0;
 }
 
+/**
+ * @brief Tell if the stack can be read or written without blocking
+ *
+ * @param filp the file
+ * @param wait the poll table
+ *
+ * @return EPOLLIN if the stack holds values, EPOLLOUT if it has room
+ */
+static __poll_t stack_poll(struct file *filp, poll_table *wait)
+{
+	struct stack_file *sfile = filp->private_data;
+	struct stack *stack = sfile->stack;
+	__poll_t mask = 0;
+
+	poll_wait(filp, &stack->data_wait, wait);
+	poll_wait(filp, &stack->space_wait, wait);
+
+	if (get_stack_size(stack) > 0)
+		mask |= EPOLLIN | EPOLLRDNORM;
+	if (get_stack_room(stack) > 0)
+		mask |= EPOLLOUT | EPOLLWRNORM;
+	return mask;
+}
+
+static void stack_vm_open(struct vm_area_struct *vma)
+{
+	struct stack *stack = vma->vm_private_data;
+
+	spin_lock(&stack->chunks_lock);
+	stack->nb_mappings++;
+	spin_unlock(&stack->chunks_lock);
+}
+
+static void stack_vm_close(struct vm_area_struct *vma)
+{
+	struct stack *stack = vma->vm_private_data;
+
+	// the pages are unmapped before the close, the next pop frees the
+	// chunks left empty
+	spin_lock(&stack->chunks_lock);
+	stack->nb_mappings--;
+	spin_unlock(&stack->chunks_lock);
+}
+
+/**
+ * @brief Give the page of the header or of a chunk to a mapping
+ *
+ * @param vmf the fault, page 0 is the header and page 1 + i the chunk i
+ *
+ * @return 0 or VM_FAULT_SIGBUS if the chunk does not exist
+ */
+static vm_fault_t stack_vm_fault(struct vm_fault *vmf)
+{
+	struct stack *stack = vmf->vma->vm_private_data;
+	struct page *page = NULL;
+
+	if (vmf->pgoff == 0) {
+		page = virt_to_page(stack->header);
+		get_page(page);
+	} else {
+		spin_lock(&stack->chunks_lock);
+		if (vmf->pgoff - 1 < stack->nb_chunks) {
+			page = virt_to_page(stack->chunks[vmf->pgoff - 1]);
+			get_page(page);
+		}
+		spin_unlock(&stack->chunks_lock);
+	}
+
+	if (!page)
+		return VM_FAULT_SIGBUS;
+	vmf->page = page;
+	return 0;
+}
+
+static const struct vm_operations_struct stack_vm_ops = {
+	.open = stack_vm_open,
+	.close = stack_vm_close,
+	.fault = stack_vm_fault,
+};
+
+/**
+ * @brief Map the stack read-only, see stack_mmap.h for the layout
+ *
+ * @param filp the file
+ * @param vma the mapping
+ *
+ * @return 0 or -EPERM if the mapping is writable
+ */
+static int stack_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct stack_file *sfile = filp->private_data;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+	vma->vm_ops = &stack_vm_ops;
+	vma->vm_private_data = sfile->stack;
+	stack_vm_open(vma);
+	return 0;
+}
+
 static const struct file_operations stack_fops = {
 	.owner = THIS_MODULE,
+	.open = stack_open,
+	.release = stack_release,
 	.read = stack_read,
 	.write = stack_write,
+	.poll = stack_poll,
+	.mmap = stack_mmap,
 };
 
 static int __init stack_init(void)
 {
+	struct device *dev;
+	char name[16];
+	unsigned int i;
 	int err;
 
 	printk("\nStack: Initializing\n");
+	if (nb_stacks == 0 || nb_stacks > MAX_STACKS) {
+		pr_err("Stack: nb_stacks must be between 1 and %d\n",
+		       MAX_STACKS);
+		return -EINVAL;
+	}
+
+	chunk_pool = mempool_create_page_pool(RESERVED_CHUNKS, 0);
+	if (!chunk_pool) {
+		pr_err("Stack: Error creating the chunk pool\n");
+		return -ENOMEM;
+	}
+
+	stacks = kcalloc(nb_stacks, sizeof(*stacks), GFP_KERNEL);
+	if (!stacks) {
+		err = -ENOMEM;
+		goto err_stacks;
+	}
+	for (i = 0; i < nb_stacks; i++) {
+		err = init_stack(&stacks[i]);
+		if (err)
+			goto err_init;
+	}
 
-	// Register the device
-	err = register_chrdev_region(MAJMIN, 1, DEVICE_NAME);
+	// Register the device, the major is chosen by the kernel
+	err = alloc_chrdev_region(&first_dev, 0, nb_stacks, DEVICE_NAME);
 	if (err != 0) {
 		pr_err("Stack: Registering char device failed\n");
-		return err;
+		goto err_region;
 	}
 
 	cl = class_create(THIS_MODULE, DEVICE_NAME);
 	if (cl == NULL) {
 		pr_err("Stack: Error creating class\n");
-		unregister_chrdev_region(MAJMIN, 1);
-		return -1;
+		err = -1;
+		goto err_class;
 	}
 	cl->dev_uevent = stack_uevent;
 
-	if (device_create(cl, NULL, MAJMIN, NULL, DEVICE_NAME) == NULL) {
-		pr_err("Stack: Error creating device\n");
-		class_destroy(cl);
-		unregister_chrdev_region(MAJMIN, 1);
-		return -1;
+	for (i = 0; i < nb_stacks; i++) {
+		if (i == 0)
+			strscpy(name, DEVICE_NAME, sizeof(name));
+		else
+			snprintf(name, sizeof(name), DEVICE_NAME "%u", i);
+		dev = device_create_with_groups(cl, NULL, first_dev + i,
+						&stacks[i], stack_groups, "%s",
+						name);
+		if (IS_ERR_OR_NULL(dev)) {
+			pr_err("Stack: Error creating device %u\n", i);
+			err = -1;
+			goto err_device;
+		}
 	}
 
 	cdev_init(&cdev, &stack_fops);
-	err = cdev_add(&cdev, MAJMIN, 1);
+	err = cdev_add(&cdev, first_dev, nb_stacks);
 	if (err < 0) {
 		pr_err("Stack: Adding char device failed\n");
-		device_destroy(cl, MAJMIN);
-		class_destroy(cl);
-		unregister_chrdev_region(MAJMIN, 1);
-		return err;
+		goto err_device;
 	}
 
-	pr_info("Stack ready!\n");
+	pr_info("Stack: %u stacks ready on major %d!\n", nb_stacks,
+		MAJOR(first_dev));
 	return 0;
+
+err_device:
+	while (i-- > 0)
+		device_destroy(cl, first_dev + i);
+	class_destroy(cl);
+err_class:
+	unregister_chrdev_region(first_dev, nb_stacks);
+err_region:
+	i = nb_stacks;
+err_init:
+	while (i-- > 0)
+		free_stack(&stacks[i]);
+	kfree(stacks);
+	stacks = NULL;
+err_stacks:
+	mempool_destroy(chunk_pool);
+	return err;
 }
 
 static void __exit stack_exit(void)
 {
-	struct element *element, *temp;
-	list_for_each_entry_safe(element, temp, &stack, list) {
-		list_del(&element->list);
-		kfree(element);
-	}
+	unsigned int i;
 
 	// Unregister the device
 	cdev_del(&cdev);
-	device_destroy(cl, MAJMIN);
+	for (i = 0; i < nb_stacks; i++)
+		device_destroy(cl, first_dev + i);
 	class_destroy(cl);
-	unregister_chrdev_region(MAJMIN, 1);
+	unregister_chrdev_region(first_dev, nb_stacks);
+
+	for (i = 0; i < nb_stacks; i++)
+		free_stack(&stacks[i]);
+	kfree(stacks);
+	stacks = NULL;
+	mempool_destroy(chunk_pool);
 
 	pr_info("Stack done!\n");
 }
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#define DEFAULT_DEVICE "/dev/stack"
+#define DEFAULT_MAX_THREADS 8
+#define DEFAULT_DURATION_MS 500
+#define MAX_BATCH 1024
+#define DRAIN_SIZE 1024
+
+static const uint32_t batches[] = { 1, 4, 16, 64, 256, 1024 };
+
+struct thread_arg {
+	pthread_t thread;
+	int fd;
+	uint32_t batch;
+	uint64_t nb_pushed;
+	uint64_t nb_popped;
+	uint64_t nb_syscalls;
+	int error;
+};
+
+static volatile int running;
+
+/* Push a batch then pop a batch until the end of the measure */
+static void *worker(void *ptr)
+{
+	struct thread_arg *arg = ptr;
+	uint32_t values[MAX_BATCH];
+	uint32_t i;
+	ssize_t ret;
+
+	for (i = 0; i < arg->batch; i++) {
+		values[i] = i;
+	}
+
+	while (running) {
+		ret = write(arg->fd, values, arg->batch * sizeof(uint32_t));
+		arg->nb_syscalls++;
+		if (ret < 0 && errno != EAGAIN && errno != ENOSPC) {
+			perror("write");
+			arg->error = 1;
+			return NULL;
+		}
+		if (ret > 0) {
+			arg->nb_pushed += ret / sizeof(uint32_t);
+		}
+
+		// other threads may have taken the values
+		ret = read(arg->fd, values, arg->batch * sizeof(uint32_t));
+		arg->nb_syscalls++;
+		if (ret < 0 && errno != EAGAIN) {
+			perror("read");
+			arg->error = 1;
+			return NULL;
+		}
+		if (ret > 0) {
+			arg->nb_popped += ret / sizeof(uint32_t);
+		}
+	}
+
+	return NULL;
+}
+
+/* Pop everything left in the stack */
+static void drain(int fd)
+{
+	uint32_t values[DRAIN_SIZE];
+
+	while (read(fd, values, sizeof(values)) > 0) {
+	}
+}
+
+static int run(int fd, uint32_t nb_threads, uint32_t batch,
+	       uint32_t duration_ms)
+{
+	struct thread_arg *args;
+	struct timespec start, end;
+	uint64_t nb_pushed = 0, nb_popped = 0, nb_syscalls = 0;
+	double elapsed;
+	uint32_t i;
+	int ret = 0;
+
+	args = calloc(nb_threads, sizeof(*args));
+	if (!args) {
+		printf("Out of memory\n");
+		return -1;
+	}
+
+	running = 1;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nb_threads; i++) {
+		args[i].fd = fd;
+		args[i].batch = batch;
+		pthread_create(&args[i].thread, NULL, worker, &args[i]);
+	}
+	usleep(duration_ms * 1000);
+	running = 0;
+	for (i = 0; i < nb_threads; i++) {
+		pthread_join(args[i].thread, NULL);
+		ret |= args[i].error ? -1 : 0;
+		nb_pushed += args[i].nb_pushed;
+		nb_popped += args[i].nb_popped;
+		nb_syscalls += args[i].nb_syscalls;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	drain(fd);
+
+	elapsed = (end.tv_sec - start.tv_sec) +
+		  (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%7u %5u %14.0f %14.0f %12.0f %10.2f\n", nb_threads, batch,
+	       nb_pushed / elapsed, nb_popped / elapsed, nb_syscalls / elapsed,
+	       nb_syscalls ? (double)(nb_pushed + nb_popped) / nb_syscalls :
+			     0);
+
+	free(args);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *device = DEFAULT_DEVICE;
+	uint32_t max_threads = DEFAULT_MAX_THREADS;
+	uint32_t duration_ms = DEFAULT_DURATION_MS;
+	uint32_t nb_threads;
+	size_t i;
+	int fd;
+
+	if (argc > 4) {
+		printf("Usage: %s [device] [max threads] [duration per run ms]\n",
+		       argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (argc > 1) {
+		device = argv[1];
+	}
+	if (argc > 2) {
+		max_threads = strtoul(argv[2], NULL, 10);
+	}
+	if (argc > 3) {
+		duration_ms = strtoul(argv[3], NULL, 10);
+	}
+	if (max_threads == 0 || duration_ms == 0) {
+		printf("Invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	// a full or empty stack must not block the threads at the end
+	fd = open(device, O_RDWR | O_NONBLOCK);
+	if (fd < 0) {
+		perror("stack_bench");
+		return EXIT_FAILURE;
+	}
+	drain(fd);
+
+	printf("threads batch       pushes/s        pops/s   syscalls/s values/call\n");
+	for (nb_threads = 1; nb_threads <= max_threads; nb_threads *= 2) {
+		for (i = 0; i < sizeof(batches) / sizeof(batches[0]); i++) {
+			if (run(fd, nb_threads, batches[i], duration_ms) < 0) {
+				printf("Benchmark failed\n");
+				return EXIT_FAILURE;
+			}
+		}
+	}
+
+	close(fd);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#define DEFAULT_DEVICE "/dev/stack"
+#define DEFAULT_ITERATIONS 100000
+#define MAX_VALUES_PARAM "/sys/module/stack/parameters/max_values"
+#define BLOCK_WHEN_FULL_PARAM "/sys/module/stack/parameters/block_when_full"
+#define DEFAULT_MAX_VALUES (1024 * 1024)
+#define MAX_OP_VALUES 2048
+#define DRAIN_SIZE 1024
+
+enum op { OP_PUSH, OP_POP, OP_INVALID, OP_EMPTY, NB_OPS };
+
+/* The stack of user space the driver is compared to */
+static uint32_t *ref;
+static size_t ref_size;
+static size_t ref_capacity;
+static int block_when_full = 1;
+
+/* Read the first line of a parameter of the module */
+static int read_param(const char *path, char *buf, size_t size)
+{
+	FILE *f;
+	int ret;
+
+	f = fopen(path, "r");
+	if (!f) {
+		return -1;
+	}
+	ret = fgets(buf, size, f) ? 0 : -1;
+	fclose(f);
+	return ret;
+}
+
+/* Push values and check the driver pushed as many as the reference */
+static int check_push(int fd, uint32_t *values, size_t nb_values)
+{
+	size_t room = ref_capacity - ref_size;
+	size_t expected = nb_values < room ? nb_values : room;
+	ssize_t ret;
+	size_t i;
+
+	for (i = 0; i < nb_values; i++) {
+		values[i] = rand();
+	}
+
+	ret = write(fd, values, nb_values * sizeof(uint32_t));
+	if (expected == 0) {
+		if (ret != -1 ||
+		    errno != (block_when_full ? EAGAIN : ENOSPC)) {
+			printf("Push on a full stack returned %zd\n", ret);
+			return -1;
+		}
+		return 0;
+	}
+	if (ret != (ssize_t)(expected * sizeof(uint32_t))) {
+		printf("Push of %zu values returned %zd, expected %zu\n",
+		       nb_values, ret, expected * sizeof(uint32_t));
+		return -1;
+	}
+
+	memcpy(&ref[ref_size], values, expected * sizeof(uint32_t));
+	ref_size += expected;
+	return 0;
+}
+
+/* Pop values and check they are the top of the reference */
+static int check_pop(int fd, uint32_t *values, size_t nb_values)
+{
+	size_t expected = nb_values < ref_size ? nb_values : ref_size;
+	ssize_t ret;
+	size_t i;
+
+	ret = read(fd, values, nb_values * sizeof(uint32_t));
+	if (expected == 0) {
+		if (ret != -1 || errno != EAGAIN) {
+			printf("Pop on an empty stack returned %zd\n", ret);
+			return -1;
+		}
+		return 0;
+	}
+	if (ret != (ssize_t)(expected * sizeof(uint32_t))) {
+		printf("Pop of %zu values returned %zd, expected %zu\n",
+		       nb_values, ret, expected * sizeof(uint32_t));
+		return -1;
+	}
+
+	for (i = 0; i < expected; i++) {
+		if (values[i] != ref[ref_size - 1 - i]) {
+			printf("Popped value %zu is %u, expected %u\n", i,
+			       values[i], ref[ref_size - 1 - i]);
+			return -1;
+		}
+	}
+	ref_size -= expected;
+	return 0;
+}
+
+/* A size that is not a multiple of a value must change nothing */
+static int check_invalid(int fd, uint32_t *values, size_t nb_values)
+{
+	size_t count = nb_values * sizeof(uint32_t) - 1 - rand() % 3;
+	ssize_t ret;
+
+	ret = rand() % 2 ? read(fd, values, count) :
+			   write(fd, values, count);
+	if (ret != -1 || errno != EINVAL) {
+		printf("Access of %zu bytes returned %zd\n", count, ret);
+		return -1;
+	}
+	return 0;
+}
+
+/* An empty access must change nothing */
+static int check_empty(int fd, uint32_t *values)
+{
+	ssize_t ret;
+
+	ret = rand() % 2 ? read(fd, values, 0) : write(fd, values, 0);
+	if (ret != 0) {
+		printf("Empty access returned %zd\n", ret);
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *device = DEFAULT_DEVICE;
+	uint32_t values[MAX_OP_VALUES];
+	unsigned long iterations = DEFAULT_ITERATIONS;
+	unsigned int seed = time(NULL);
+	unsigned long i;
+	size_t nb_values;
+	char param[32];
+	int fd, ret;
+
+	if (argc > 4) {
+		printf("Usage: %s [device] [iterations] [seed]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (argc > 1) {
+		device = argv[1];
+	}
+	if (argc > 2) {
+		iterations = strtoul(argv[2], NULL, 10);
+	}
+	if (argc > 3) {
+		seed = strtoul(argv[3], NULL, 10);
+	}
+	srand(seed);
+
+	ref_capacity = DEFAULT_MAX_VALUES;
+	if (read_param(MAX_VALUES_PARAM, param, sizeof(param)) == 0) {
+		ref_capacity = strtoul(param, NULL, 10);
+	}
+	if (read_param(BLOCK_WHEN_FULL_PARAM, param, sizeof(param)) == 0) {
+		block_when_full = param[0] == 'Y';
+	}
+	ref = malloc((ref_capacity + 1) * sizeof(uint32_t));
+	if (!ref) {
+		printf("Out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	// nothing may block, the reference tells what to expect instead
+	fd = open(device, O_RDWR | O_NONBLOCK);
+	if (fd < 0) {
+		perror("stack_fuzz");
+		return EXIT_FAILURE;
+	}
+	while (read(fd, values, DRAIN_SIZE * sizeof(uint32_t)) > 0) {
+	}
+
+	printf("Seed %u, %lu operations, capacity %zu\n", seed, iterations,
+	       ref_capacity);
+	for (i = 0; i < iterations; i++) {
+		// small and big batches, the big ones cross the chunks
+		nb_values = rand() % 4 ? 1 + rand() % 16 :
+					 1 + rand() % MAX_OP_VALUES;
+		switch (rand() % NB_OPS) {
+		case OP_PUSH:
+			ret = check_push(fd, values, nb_values);
+			break;
+		case OP_POP:
+			ret = check_pop(fd, values, nb_values);
+			break;
+		case OP_INVALID:
+			ret = check_invalid(fd, values, nb_values);
+			break;
+		default:
+			ret = check_empty(fd, values);
+			break;
+		}
+		if (ret < 0) {
+			printf("Test failed at operation %lu with seed %u\n", i,
+			       seed);
+			return EXIT_FAILURE;
+		}
+	}
+
+	// what is left must be the whole reference
+	while (ref_size > 0) {
+		if (check_pop(fd, values, MAX_OP_VALUES) < 0) {
+			printf("Test failed while draining with seed %u\n",
+			       seed);
+			return EXIT_FAILURE;
+		}
+	}
+	if (check_pop(fd, values, 1) < 0) {
+		return EXIT_FAILURE;
+	}
+
+	printf("Test run successfully!\n");
+	free(ref);
+	close(fd);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Layout of a stack mapped read-only with mmap, shared with user space
+ *
+ * Page 0 of the mapping is the header, page 1 + i is the chunk i of the
+ * stack. The value at index n is value n % values_per_chunk of chunk
+ * n / values_per_chunk, the top of the stack is at index size - 1.
+ */
+#ifndef STACK_MMAP_H
+#define STACK_MMAP_H
+
+#include <linux/types.h>
+
+/**
+ * struct stack_header - first page of the mapping
+ *
+ * @generation: odd while the stack is modified, a reader retries if it is
+ *              odd or changed during its read
+ * @values_per_chunk: number of values in a chunk, one page
+ * @size: number of values in the stack
+ */
+struct stack_header {
+	__u32 generation;
+	__u32 values_per_chunk;
+	__u64 size;
+};
+
+#endif /* STACK_MMAP_H */
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#define DEFAULT_MAX_THREADS 8
+#define DEFAULT_ITERATIONS 10000
+#define DEFAULT_BATCH 1
+#define MAX_BATCH 1024
+#define INDEX_BITS 24
+#define INDEX_MASK ((1u << INDEX_BITS) - 1)
+#define DRAIN_SIZE 1024
+
+struct thread_arg {
+	pthread_t thread;
+	uint32_t id;
+	int fd;
+	int error;
+};
+
+static uint32_t nb_threads;
+static uint32_t iterations;
+static uint32_t batch;
+static uint8_t *seen; // how many times each pushed value was popped
+
+/* Count a popped value, each value is pushed once and must be popped once */
+static int check_value(uint32_t value)
+{
+	uint32_t thread = value >> INDEX_BITS;
+	uint32_t index = value & INDEX_MASK;
+
+	if (thread >= nb_threads || index >= iterations * batch) {
+		printf("Popped unknown value 0x%08x\n", value);
+		return -1;
+	}
+	__atomic_fetch_add(&seen[thread * iterations * batch + index], 1,
+			   __ATOMIC_RELAXED);
+	return 0;
+}
+
+static void *worker(void *ptr)
+{
+	struct thread_arg *arg = ptr;
+	uint32_t values[MAX_BATCH];
+	uint32_t counter = 0;
+	uint32_t i, j;
+	ssize_t ret;
+
+	for (i = 0; i < iterations; i++) {
+		for (j = 0; j < batch; j++) {
+			values[j] = (arg->id << INDEX_BITS) | counter++;
+		}
+		if (write(arg->fd, values, batch * sizeof(uint32_t)) !=
+		    (ssize_t)(batch * sizeof(uint32_t))) {
+			perror("write");
+			arg->error = 1;
+			return NULL;
+		}
+
+		// other threads may have taken the values, less can be read
+		ret = read(arg->fd, values, batch * sizeof(uint32_t));
+		if (ret < 0 && errno == EAGAIN) {
+			ret = 0;
+		}
+		if (ret < 0) {
+			perror("read");
+			arg->error = 1;
+			return NULL;
+		}
+		for (j = 0; j < ret / sizeof(uint32_t); j++) {
+			if (check_value(values[j]) < 0) {
+				arg->error = 1;
+				return NULL;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/* Pop everything left in the stack */
+static int drain(int fd, int check)
+{
+	uint32_t values[DRAIN_SIZE];
+	ssize_t ret;
+	ssize_t i;
+
+	while ((ret = read(fd, values, sizeof(values))) > 0) {
+		for (i = 0; check && i < ret / (ssize_t)sizeof(uint32_t); i++) {
+			if (check_value(values[i]) < 0) {
+				return -1;
+			}
+		}
+	}
+	if (ret < 0 && errno != EAGAIN) {
+		perror("read");
+		return -1;
+	}
+	return 0;
+}
+
+static int run(int fd)
+{
+	struct thread_arg *args;
+	struct timespec start, end;
+	size_t nb_values = (size_t)nb_threads * iterations * batch;
+	double elapsed;
+	uint32_t i;
+	int ret = 0;
+
+	args = calloc(nb_threads, sizeof(*args));
+	seen = calloc(nb_values, 1);
+	if (!args || !seen) {
+		printf("Out of memory\n");
+		free(args);
+		free(seen);
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nb_threads; i++) {
+		args[i].id = i;
+		args[i].fd = fd;
+		pthread_create(&args[i].thread, NULL, worker, &args[i]);
+	}
+	for (i = 0; i < nb_threads; i++) {
+		pthread_join(args[i].thread, NULL);
+		ret |= args[i].error ? -1 : 0;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (ret == 0) {
+		ret = drain(fd, 1);
+	}
+	for (i = 0; ret == 0 && i < nb_values; i++) {
+		if (seen[i] != 1) {
+			printf("Value 0x%08x popped %u times\n",
+			       ((i / (iterations * batch)) << INDEX_BITS) |
+				       (i % (iterations * batch)),
+			       seen[i]);
+			ret = -1;
+		}
+	}
+
+	elapsed = (end.tv_sec - start.tv_sec) +
+		  (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%2u threads, batch %4u: %10.0f values pushed and popped/s\n",
+	       nb_threads, batch, 2 * nb_values / elapsed);
+
+	free(args);
+	free(seen);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t max_threads = DEFAULT_MAX_THREADS;
+	int fd;
+
+	iterations = DEFAULT_ITERATIONS;
+	batch = DEFAULT_BATCH;
+	if (argc > 4) {
+		printf("Usage: %s [max threads] [iterations] [batch]\n",
+		       argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (argc > 1) {
+		max_threads = strtoul(argv[1], NULL, 10);
+	}
+	if (argc > 2) {
+		iterations = strtoul(argv[2], NULL, 10);
+	}
+	if (argc > 3) {
+		batch = strtoul(argv[3], NULL, 10);
+	}
+	if (max_threads == 0 || max_threads > (1u << (32 - INDEX_BITS)) ||
+	    batch == 0 || batch > MAX_BATCH || iterations == 0 ||
+	    (uint64_t)iterations * batch > INDEX_MASK) {
+		printf("Invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	// the stack is drained until empty, reads must not block
+	fd = open("/dev/stack", O_RDWR | O_NONBLOCK);
+	if (fd < 0) {
+		perror("stack_mt_test");
+		return EXIT_FAILURE;
+	}
+
+	// the values of a previous run are not checked
+	if (drain(fd, 0) < 0) {
+		return EXIT_FAILURE;
+	}
+
+	printf("Every value pushed must be popped exactly once.\n");
+	for (nb_threads = 1; nb_threads <= max_threads; nb_threads *= 2) {
+		if (run(fd) < 0) {
+			printf("Test failed with %u threads\n", nb_threads);
+			return EXIT_FAILURE;
+		}
+	}
+
+	printf("Test run successfully!\n");
+	close(fd);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "stack_mmap.h"
+
+#define DEFAULT_DEVICE "/dev/stack"
+#define DEFAULT_NB_VALUES 10
+#define MAX_NB_VALUES 1024
+
+/* Length of a mapping holding the header and the first size values */
+static size_t map_stack_length(size_t page_size, uint32_t values_per_chunk,
+			       uint64_t size)
+{
+	return (1 + (size + values_per_chunk - 1) / values_per_chunk) *
+	       page_size;
+}
+
+static void *map_stack(int fd, size_t length)
+{
+	void *map;
+
+	map = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+	return map == MAP_FAILED ? NULL : map;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *device = DEFAULT_DEVICE;
+	uint32_t values[MAX_NB_VALUES];
+	struct stack_header *header;
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	uint32_t nb_values = DEFAULT_NB_VALUES;
+	uint32_t generation, vpc, i;
+	uint64_t size, index;
+	size_t length;
+	void *map;
+	int fd;
+
+	if (argc > 3) {
+		printf("Usage: %s [device] [number of values]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (argc > 1) {
+		device = argv[1];
+	}
+	if (argc > 2) {
+		nb_values = strtoul(argv[2], NULL, 10);
+	}
+	if (nb_values == 0 || nb_values > MAX_NB_VALUES) {
+		printf("Invalid number of values\n");
+		return EXIT_FAILURE;
+	}
+
+	fd = open(device, O_RDONLY);
+	if (fd < 0) {
+		perror("stack_peek");
+		return EXIT_FAILURE;
+	}
+
+	// only the header until its size is known
+	length = page_size;
+	map = map_stack(fd, length);
+	if (!map) {
+		perror("mmap");
+		return EXIT_FAILURE;
+	}
+
+	// the copy is retried until no update happened during it
+	for (;;) {
+		header = map;
+		generation = __atomic_load_n(&header->generation,
+					     __ATOMIC_ACQUIRE);
+		if (generation & 1) {
+			usleep(100);
+			continue;
+		}
+		vpc = header->values_per_chunk;
+		size = header->size;
+
+		// the stack grew beyond the mapping
+		if (length < map_stack_length(page_size, vpc, size)) {
+			munmap(map, length);
+			length = map_stack_length(page_size, vpc, size);
+			map = map_stack(fd, length);
+			if (!map) {
+				perror("mmap");
+				return EXIT_FAILURE;
+			}
+			continue;
+		}
+
+		for (i = 0; i < nb_values && i < size; i++) {
+			index = size - 1 - i;
+			values[i] = ((uint32_t *)((char *)map +
+						  (1 + index / vpc) *
+							  page_size))[index %
+								      vpc];
+		}
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&header->generation, __ATOMIC_RELAXED) ==
+		    generation) {
+			break;
+		}
+	}
+
+	printf("Stack of %llu values, generation %u\n",
+	       (unsigned long long)size, generation);
+	for (i = 0; i < nb_values && i < size; i++) {
+		printf("%u: %u\n", i, values[i]);
+	}
+
+	munmap(map, length);
+	close(fd);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,78 @@
+#include "commands.h"
+#include <linux/errno.h>
+#include <linux/printk.h>
+
+#define LIB_NAME "commands"
+#define COMMANDS_RING_MASK (COMMANDS_RING_SIZE - 1)
+
+void init_command_ring(struct command_ring *ring)
+{
+	for (int i = 0; i < COMMANDS_RING_SIZE; i++) {
+		atomic_set(&ring->slots[i].seq, i);
+	}
+	atomic_set(&ring->tail, 0);
+	ring->head = 0;
+	atomic_set(&ring->nb_enqueued, 0);
+	atomic_set(&ring->nb_applied, 0);
+	atomic_set(&ring->nb_dropped, 0);
+}
+
+int push_command(struct command_ring *ring, uint8_t command)
+{
+	struct command_slot *slot;
+	int pos;
+	int diff;
+
+	pos = atomic_read(&ring->tail);
+	for (;;) {
+		slot = &ring->slots[pos & COMMANDS_RING_MASK];
+		diff = atomic_read_acquire(&slot->seq) - pos;
+		if (diff == 0) {
+			// the slot is free, it is reserved if no other
+			// producer took this position meanwhile
+			if (atomic_try_cmpxchg_relaxed(&ring->tail, &pos,
+						       pos + 1)) {
+				break;
+			}
+		} else if (diff < 0) {
+			// the slot still holds a command of the previous lap
+			atomic_inc(&ring->nb_dropped);
+			pr_warn_ratelimited("[%s]: Ring full, command %u dropped\n",
+					    LIB_NAME, command);
+			return -ENOSPC;
+		} else {
+			pos = atomic_read(&ring->tail);
+		}
+	}
+
+	slot->command = command;
+	/// publish the command, the consumer reads it after seeing the seq
+	atomic_set_release(&slot->seq, pos + 1);
+	atomic_inc(&ring->nb_enqueued);
+	return 0;
+}
+
+bool pop_command(struct command_ring *ring, uint8_t *command)
+{
+	struct command_slot *slot;
+
+	slot = &ring->slots[ring->head & COMMANDS_RING_MASK];
+	if (atomic_read_acquire(&slot->seq) != (int)(ring->head + 1)) {
+		return false;
+	}
+
+	*command = slot->command;
+	/// give the slot back to the producers of the next lap
+	atomic_set_release(&slot->seq, ring->head + COMMANDS_RING_SIZE);
+	ring->head++;
+	atomic_inc(&ring->nb_applied);
+	return true;
+}
+
+void get_command_ring_stats(struct command_ring *ring,
+			    struct command_stats *stats)
+{
+	stats->enqueued = atomic_read(&ring->nb_enqueued);
+	stats->applied = atomic_read(&ring->nb_applied);
+	stats->dropped = atomic_read(&ring->nb_dropped);
+}
@@ -0,0 +1,63 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include <linux/atomic.h>
+#include <linux/types.h>
+
+#define COMMANDS_RING_SIZE 32 // must be a power of 2
+
+///@brief a slot of the command ring
+///@note seq tells the state of the slot: equal to the position of a producer
+/// when the slot is free, to the position + 1 once the command is written
+struct command_slot {
+	atomic_t seq;
+	uint8_t command;
+};
+
+///@brief lock free queue of the commands sent to the player work
+///@note any number of producers (irq thread, sysfs, write, ioctl) and a single
+/// consumer (the player work), the producers only reserve a slot with a
+/// cmpxchg on the tail
+struct command_ring {
+	struct command_slot slots[COMMANDS_RING_SIZE];
+	atomic_t tail; // next position to produce
+	unsigned int head; // next position to consume, only used by the consumer
+	atomic_t nb_enqueued;
+	atomic_t nb_applied;
+	atomic_t nb_dropped;
+};
+
+///@brief counters of a command ring
+struct command_stats {
+	uint32_t enqueued;
+	uint32_t applied;
+	uint32_t dropped;
+};
+
+/// @brief Initialize a command ring
+/// @param ring the ring to initialize
+void init_command_ring(struct command_ring *ring);
+
+/// @brief Add a command at the end of the ring
+/// @param ring the ring
+/// @param command the command
+/// @return 0 if no error, -ENOSPC if the ring is full then the command is
+/// counted as dropped
+/// @note this method never sleeps and can be called from any context
+int push_command(struct command_ring *ring, uint8_t command);
+
+/// @brief Take the first command of the ring
+/// @param ring the ring
+/// @param command the buffer to store the command
+/// @return true if a command was taken
+/// @note only the consumer can call this method, the command is counted as
+/// applied
+bool pop_command(struct command_ring *ring, uint8_t *command);
+
+/// @brief Get the counters of a command ring
+/// @param ring the ring
+/// @param stats the buffer to store the counters
+void get_command_ring_stats(struct command_ring *ring,
+			    struct command_stats *stats);
+
+#endif // COMMANDS_H
@@ -1,10 +1,16 @@
 #include "keys.h"
 #include "hex.h"
-#include "music.h"
+#include "song.h"
 #include "player.h"
 #include "playlist.h"
+#include "players.h"
 #include "drivify_shared_types.h"
 #include "drivify_sysfs.h"
+#include "events.h"
+#include "snapshot.h"
+#include "drivify_ioctl.h"
+#include "drivify_platform.h"
+#include "lock_stats.h"
 #include <linux/init.h>
 #include <linux/cdev.h>
 #include <linux/fs.h>
@@ -19,12 +25,16 @@
 #include <linux/slab.h>
 #include <linux/uaccess.h>
 #include <linux/kfifo.h>
+#include <linux/poll.h>
+#include <linux/mutex.h>
+#include <linux/mm.h>
 
-#define DEVICE_NAME "drivify"
+#define DEVICE_NAME DRIVIFY_DRIVER_NAME
 #define USED_KEYS_MASK 0x07
-#define LED_OFFSET 0x00
-#define HEX_OFFSET_0_3 0x20
-#define HEX_OFFSET_4_5 0x30
+#define KEY_PLAY_PAUSE 0
+#define KEY_REWIND 1
+#define KEY_NEXT 2
+#define EVENTS_PER_READ 16
 
 ///@brief the probe method called when the device is detected
 ///@param pdev the platform device detected
@@ -75,21 +85,80 @@ static ssize_t drivify_write(struct file *filp, const char __user *buf,
 ///@param filp the file pointer
 ///@param buf the buffer to read
 ///@param count the number of bytes to read
-///@param ppos the position in the file
+///@param ppos the position in the file, used as the event cursor
 ///@return the number of bytes read
+///@note the read blocks until an event is available unless O_NONBLOCK is set
 static ssize_t drivify_read(struct file *filp, char __user *buf, size_t count,
 			    loff_t *ppos);
+
+///@brief the poll method called when the device is polled
+///@param filp the file pointer
+///@param wait the poll table
+///@return the mask of the available operations
+static __poll_t drivify_poll(struct file *filp, poll_table *wait);
+
+///@brief the ioctl method used to export and import the playlist and to
+/// manage the players
+///@param filp the file pointer
+///@param cmd the command, one of DRIVIFY_IOC_*
+///@param arg the address of the argument of the command
+///@return 0 if no error
+static long drivify_ioctl(struct file *filp, unsigned int cmd,
+			  unsigned long arg);
+
+///@brief export the playlist to user space
+///@param player the player to export
+///@param snapshot the buffer given by user space
+///@param arg the address of the snapshot in user space to update the size
+///@return 0 if no error, -ENOSPC if the buffer is too small
+static long export_playlist(struct player *player,
+			    struct drivify_snapshot *snapshot,
+			    unsigned long arg);
+
+///@brief import the playlist from user space
+///@param player the player to import to
+///@param snapshot the buffer given by user space
+///@return 0 if no error
+static long import_playlist(struct player *player,
+			    struct drivify_snapshot *snapshot);
+
+///@brief select the player used by a file
+///@param dfile the state of the file, its lock must be held
+///@param arg the address of the number of the player in user space
+///@return 0 if no error
+static long select_player(struct drivify_file *dfile, unsigned long arg);
+
+///@brief free the private structure once the device and all the files are released
+///@param refcount the reference counter of the private structure
+static void drivify_free_priv(struct kref *refcount);
+
+///@brief drop the reference of the device on the private structure
+///@param dev the char device, released after the char device and its files
+static void drivify_device_release(struct device *dev);
+
 ///@brief method to setup the irq
 ///@param priv the private structure of the device
 ///@param pdev the platform device
 ///@return 0 if no error
 static int setup_irq(struct priv *priv, struct platform_device *pdev);
 
-///@brief the handler of the irq
+///@brief the handler of the irq, it only acknowledges and queues the key presses
 ///@param irq the irq number
 ///@param dev_id the device id
+///@return IRQ_WAKE_THREAD if a press was queued
 static irqreturn_t irq_handler(int irq, void *dev_id);
 
+///@brief the threaded handler of the irq, it applies the queued key presses
+///@param irq the irq number
+///@param dev_id the device id
+///@return IRQ_HANDLED
+static irqreturn_t irq_thread(int irq, void *dev_id);
+
+///@brief apply the command of a key to the player
+///@param priv the private structure of the device
+///@param key the index of the key pressed
+static void handle_key(struct priv *priv, uint8_t key);
+
 ///@brief the matching table of the device
 static const struct of_device_id drivify_of_match[] = {
 	{
@@ -116,14 +185,18 @@ static struct file_operations drivify_fops = {
 	.release = drivify_release,
 	.read = drivify_read,
 	.write = drivify_write,
+	.poll = drivify_poll,
+	.unlocked_ioctl = drivify_ioctl,
 };
 
-///@brief the structure of the hardware registers
-struct hw_registers {
-	void __iomem *keys_reg;
-	void __iomem *hex_0_3_reg;
-	void __iomem *hex_4_5_reg;
-	void __iomem *led_reg;
+///@brief the state of an opened file
+struct drivify_file {
+	struct priv *priv;
+	struct player *player; // player selected by the file, the first one by default
+	struct mutex lock; // protects the player, the cursor and the staging of the file
+	uint32_t event_cursor; // sequence number of the next event to read
+	uint8_t staging[MUSIC_RECORD_MAX_SIZE]; // music record being written
+	size_t staged; // number of bytes of the staging record already written
 };
 
 static int drivify_uevent(struct device *dev, struct kobj_uevent_env *env)
@@ -137,6 +210,7 @@ static int __init drivify_init(void)
 {
 	int ret;
 	pr_info("[%s]: Initializing\n", DEVICE_NAME);
+	init_lock_stats_debugfs();
 	ret = platform_driver_register(&drivify_driver);
 	return 0;
 }
@@ -145,25 +219,35 @@ static void __exit drivify_exit(void)
 {
 	pr_info("[%s]: Exiting\n", DEVICE_NAME);
 	platform_driver_unregister(&drivify_driver);
+	remove_lock_stats_debugfs();
 }
 
 static int drivify_open(struct inode *inode, struct file *filp)
 {
+	struct drivify_file *dfile;
 	struct priv *priv;
 
-	priv = container_of(filp->f_inode->i_cdev, struct priv, cdev);
-	if (!priv) {
-		pr_err("[%s]: priv is NULL in open\n", DEVICE_NAME);
-		return -EINVAL;
+	/// the char device, so the private structure, is held by the open
+	priv = container_of(inode->i_cdev, struct priv, cdev);
+	if (!kref_get_unless_zero(&priv->refcount)) {
+		pr_err("[%s]: device released in open\n", DEVICE_NAME);
+		return -ENODEV;
 	}
 
-	if (priv->is_open) {
-		pr_err("[%s]: Device already open\n", DEVICE_NAME);
-		return -EBUSY;
+	dfile = kzalloc(sizeof(struct drivify_file), GFP_KERNEL);
+	if (!dfile) {
+		pr_err("[%s]: Error allocating file state\n", DEVICE_NAME);
+		kref_put(&priv->refcount, drivify_free_priv);
+		return -ENOMEM;
 	}
 
-	priv->is_open = true;
-	filp->private_data = priv;
+	dfile->priv = priv;
+	dfile->player = get_player(priv, 0);
+	mutex_init(&dfile->lock);
+	dfile->event_cursor = get_first_cursor(&dfile->player->events);
+	dfile->staged = 0;
+
+	filp->private_data = dfile;
 	pr_info("[%s]: Opening\n", DEVICE_NAME);
 
 	return 0;
@@ -171,15 +255,21 @@ static int drivify_open(struct inode *inode, struct file *filp)
 
 static int drivify_release(struct inode *inode, struct file *filp)
 {
-	struct priv *priv;
+	struct drivify_file *dfile;
 
-	priv = (struct priv *)filp->private_data;
-	if (!priv) {
-		pr_err("[%s]: priv is NULL in close\n", DEVICE_NAME);
+	dfile = (struct drivify_file *)filp->private_data;
+	if (!dfile) {
+		pr_err("[%s]: file state is NULL in close\n", DEVICE_NAME);
 		return -EINVAL;
 	}
 
-	priv->is_open = false;
+	if (dfile->staged != 0) {
+		pr_warn("[%s]: Dropping a partially written song\n",
+			DEVICE_NAME);
+	}
+
+	kref_put(&dfile->priv->refcount, drivify_free_priv);
+	kfree(dfile);
 	pr_info("[%s]: Releasing\n", DEVICE_NAME);
 	return 0;
 }
@@ -187,40 +277,373 @@ static int drivify_release(struct inode *inode, struct file *filp)
 static ssize_t drivify_read(struct file *filp, char __user *buf, size_t count,
 			    loff_t *ppos)
 {
-	pr_info("[%s]: Reading this fs do nothing\n", DEVICE_NAME);
-	return 0;
+	struct drivify_event events[EVENTS_PER_READ];
+	struct drivify_file *dfile;
+	struct event_log *log;
+	struct priv *priv;
+	int max_events;
+	int nb_events;
+	int err;
+
+	dfile = (struct drivify_file *)filp->private_data;
+	if (!dfile) {
+		pr_err("[%s]: file state is NULL in read\n", DEVICE_NAME);
+		return -EINVAL;
+	}
+
+	if (count < sizeof(struct drivify_event)) {
+		return -EINVAL;
+	}
+
+	priv = dfile->priv;
+	max_events = min_t(size_t, count / sizeof(struct drivify_event),
+			   EVENTS_PER_READ);
+
+	if (mutex_lock_interruptible(&dfile->lock)) {
+		return -ERESTARTSYS;
+	}
+	log = &dfile->player->events;
+
+	while (!has_events(log, dfile->event_cursor)) {
+		mutex_unlock(&dfile->lock);
+		if (filp->f_flags & O_NONBLOCK) {
+			return -EAGAIN;
+		}
+		err = wait_event_interruptible(
+			log->wait_queue,
+			has_events(log, READ_ONCE(dfile->event_cursor)) ||
+				!READ_ONCE(priv->is_running));
+		if (err) {
+			return err;
+		}
+		if (!READ_ONCE(priv->is_running)) {
+			return -ENODEV;
+		}
+		if (mutex_lock_interruptible(&dfile->lock)) {
+			return -ERESTARTSYS;
+		}
+		// the file may have selected another player meanwhile
+		log = &dfile->player->events;
+	}
+
+	nb_events = read_events(log, &dfile->event_cursor, events, max_events);
+	mutex_unlock(&dfile->lock);
+
+	if (copy_to_user(buf, events,
+			 nb_events * sizeof(struct drivify_event)) != 0) {
+		pr_err("[%s]: Failed to copy events to user\n", DEVICE_NAME);
+		return -EFAULT;
+	}
+
+	return nb_events * sizeof(struct drivify_event);
+}
+
+static __poll_t drivify_poll(struct file *filp, poll_table *wait)
+{
+	struct drivify_file *dfile;
+	struct event_log *log;
+	struct player *player;
+	struct playlist *playlist;
+	__poll_t mask;
+
+	dfile = (struct drivify_file *)filp->private_data;
+	if (!dfile) {
+		pr_err("[%s]: file state is NULL in poll\n", DEVICE_NAME);
+		return EPOLLERR;
+	}
+
+	player = READ_ONCE(dfile->player);
+	log = &player->events;
+	playlist = player->playlist;
+	poll_wait(filp, &log->wait_queue, wait);
+	poll_wait(filp, &playlist->space_wait_queue, wait);
+
+	if (!READ_ONCE(dfile->priv->is_running)) {
+		return EPOLLHUP | EPOLLERR;
+	}
+
+	mask = 0;
+	if (playlist_has_space(playlist)) {
+		mask |= EPOLLOUT | EPOLLWRNORM;
+	}
+	if (has_events(log, READ_ONCE(dfile->event_cursor))) {
+		mask |= EPOLLIN | EPOLLRDNORM;
+	}
+	return mask;
 }
 
 static ssize_t drivify_write(struct file *filp, const char __user *buf,
 			     size_t count, loff_t *ppos)
 {
-	struct music music;
+	struct drivify_file *dfile;
 	struct priv *priv;
+	struct player *player;
+	struct song song;
+	size_t accepted = 0;
+	size_t written = 0;
+	size_t needed;
+	size_t chunk;
+	ssize_t ret;
+	int err;
 
-	priv = (struct priv *)filp->private_data;
-
-	if (count > 100) {
-		pr_err("[%s]: Buffer too big\n", DEVICE_NAME);
+	dfile = (struct drivify_file *)filp->private_data;
+	if (!dfile) {
+		pr_err("[%s]: file state is NULL in write\n", DEVICE_NAME);
 		return -EINVAL;
 	}
+	priv = dfile->priv;
 
-	if (!priv) {
-		pr_err("[%s]: priv is NULL in write\n", DEVICE_NAME);
+	pr_debug("[%s]: Writing\n", DEVICE_NAME);
+
+	if (mutex_lock_interruptible(&dfile->lock)) {
+		return -ERESTARTSYS;
+	}
+	player = dfile->player;
+
+	/// the device can be removed while the file is still open, then the
+	/// player is only used while the device is known to be running
+	down_read(&priv->running_lock);
+	if (!priv->is_running) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	/// a song can be split in several writes and several songs can be
+	/// written at once, the bytes are staged until a record is complete.
+	/// The size of a record is only known once its header is staged.
+	while (written < count) {
+		/// the budget is only checked before a new record, a record
+		/// already started is always completed
+		while (dfile->staged == 0 &&
+		       !playlist_has_space(player->playlist)) {
+			if (accepted > 0) {
+				ret = accepted;
+				goto out_refresh;
+			}
+			if (filp->f_flags & O_NONBLOCK) {
+				ret = -EAGAIN;
+				goto out;
+			}
+			// the file stays usable by its readers and ioctls while
+			// the writer waits for the songs to be played
+			up_read(&priv->running_lock);
+			mutex_unlock(&dfile->lock);
+			err = wait_event_interruptible(
+				player->playlist->space_wait_queue,
+				playlist_has_space(player->playlist) ||
+					!READ_ONCE(priv->is_running));
+			if (err) {
+				return err;
+			}
+			if (mutex_lock_interruptible(&dfile->lock)) {
+				return -ERESTARTSYS;
+			}
+			// the file may have selected another player and staged
+			// bytes meanwhile, both are checked again by the loop
+			player = dfile->player;
+			down_read(&priv->running_lock);
+			if (!priv->is_running) {
+				ret = -ENODEV;
+				goto out;
+			}
+		}
+
+		needed = sizeof(struct music);
+		if (dfile->staged >= sizeof(struct music)) {
+			needed = music_record_size(
+				(struct music *)dfile->staging);
+		}
+		chunk = min(count - written, needed - dfile->staged);
+		if (copy_from_user(dfile->staging + dfile->staged,
+				   buf + written, chunk) != 0) {
+			pr_err("Failed to copy data from user\n");
+			dfile->staged = 0;
+			ret = accepted > 0 ? accepted : -EFAULT;
+			goto out_refresh;
+		}
+		dfile->staged += chunk;
+		written += chunk;
+
+		if (dfile->staged < needed) {
+			break;
+		}
+
+		// the header is complete, its strings are still needed
+		needed = music_record_size((struct music *)dfile->staging);
+		if (dfile->staged < needed) {
+			continue;
+		}
+
+		dfile->staged = 0;
+		err = song_from_record(&player->pool, dfile->staging, needed,
+				       &song);
+		if (err >= 0) {
+			err = set_music_to_playlist(player->playlist, &song,
+						    &player->queue_lock);
+			if (err) {
+				release_song(&player->pool, &song);
+			}
+		}
+		if (err) {
+			// the rejected song is not reported as written
+			ret = accepted > 0 ? accepted : err;
+			goto out_refresh;
+		}
+		accepted = written;
+	}
+	ret = written;
+
+out_refresh:
+	refresh_player(player);
+out:
+	up_read(&priv->running_lock);
+	mutex_unlock(&dfile->lock);
+	return ret;
+}
+
+static long drivify_ioctl(struct file *filp, unsigned int cmd,
+			  unsigned long arg)
+{
+	struct drivify_snapshot snapshot;
+	struct drivify_file *dfile;
+	struct priv *priv;
+	long ret;
+
+	dfile = (struct drivify_file *)filp->private_data;
+	if (!dfile) {
+		pr_err("[%s]: file state is NULL in ioctl\n", DEVICE_NAME);
 		return -EINVAL;
 	}
+	priv = dfile->priv;
+
+	switch (cmd) {
+	case DRIVIFY_IOC_EXPORT:
+	case DRIVIFY_IOC_IMPORT:
+		if (copy_from_user(&snapshot, (void __user *)arg,
+				   sizeof(snapshot))) {
+			return -EFAULT;
+		}
+		break;
+	case DRIVIFY_IOC_ADD_PLAYER:
+	case DRIVIFY_IOC_SELECT_PLAYER:
+		break;
+	default:
+		return -ENOTTY;
+	}
+
+	if (mutex_lock_interruptible(&dfile->lock)) {
+		return -ERESTARTSYS;
+	}
+	down_read(&priv->running_lock);
+	if (!priv->is_running) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	switch (cmd) {
+	case DRIVIFY_IOC_EXPORT:
+		ret = export_playlist(dfile->player, &snapshot, arg);
+		break;
+	case DRIVIFY_IOC_IMPORT:
+		ret = import_playlist(dfile->player, &snapshot);
+		break;
+	case DRIVIFY_IOC_ADD_PLAYER:
+		ret = add_player(priv);
+		if (ret >= 0) {
+			ret = put_user((uint32_t)ret, (uint32_t __user *)arg);
+		}
+		break;
+	default:
+		ret = select_player(dfile, arg);
+		break;
+	}
+
+out:
+	up_read(&priv->running_lock);
+	mutex_unlock(&dfile->lock);
+	return ret;
+}
+
+static long select_player(struct drivify_file *dfile, unsigned long arg)
+{
+	struct player *player;
+	uint32_t id;
 
-	pr_info("[%s]: Writing\n", DEVICE_NAME);
-	if (copy_from_user(&music, buf, count) != 0) {
-		pr_err("Failed to copy data from user\n");
+	if (get_user(id, (uint32_t __user *)arg)) {
 		return -EFAULT;
 	}
 
-	set_music_to_playlist(priv->player->playlist, &music,
-			      &priv->player->playlist_lock);
+	player = get_player(dfile->priv, id);
+	if (!player) {
+		return -EINVAL;
+	}
+
+	// the staged bytes belong to a song of the previous player
+	if (dfile->staged != 0) {
+		return -EBUSY;
+	}
+
+	/// the events of the new player are read from now on
+	dfile->player = player;
+	dfile->event_cursor = get_first_cursor(&player->events);
+	return 0;
+}
+
+static long export_playlist(struct player *player,
+			    struct drivify_snapshot *snapshot,
+			    unsigned long arg)
+{
+	size_t buffer_size;
+	size_t size;
+	void *blob;
+	long ret;
+
+	ret = build_snapshot(player, &blob, &size);
+	if (ret) {
+		return ret;
+	}
 
-	refresh_player(priv->player);
+	buffer_size = snapshot->size;
+	snapshot->size = size;
+	if (copy_to_user((void __user *)arg, snapshot, sizeof(*snapshot))) {
+		ret = -EFAULT;
+	} else if (buffer_size < size) {
+		ret = -ENOSPC;
+	} else if (copy_to_user(u64_to_user_ptr(snapshot->addr), blob, size)) {
+		ret = -EFAULT;
+	}
 
-	return count;
+	kvfree(blob);
+	return ret;
+}
+
+static long import_playlist(struct player *player,
+			    struct drivify_snapshot *snapshot)
+{
+	void *blob;
+	long ret;
+
+	if (snapshot->size > SNAPSHOT_MAX_SIZE) {
+		pr_err("[%s]: Snapshot too big\n", DEVICE_NAME);
+		return -E2BIG;
+	}
+
+	blob = kvmalloc(snapshot->size, GFP_KERNEL);
+	if (!blob) {
+		return -ENOMEM;
+	}
+
+	if (copy_from_user(blob, u64_to_user_ptr(snapshot->addr),
+			   snapshot->size)) {
+		kvfree(blob);
+		return -EFAULT;
+	}
+
+	ret = restore_snapshot(player, blob, snapshot->size);
+	refresh_player(player);
+
+	kvfree(blob);
+	return ret;
 }
 
 static int drivify_probe(struct platform_device *pdev)
@@ -228,30 +651,50 @@ static int drivify_probe(struct platform_device *pdev)
 	int err;
 	struct priv *priv;
 	struct resource *res;
+	struct drivify_platform_data *pdata;
 	void __iomem *base_addr;
 
 	pr_info("[%s]: Probing\n", DEVICE_NAME);
-	priv = devm_kzalloc(&pdev->dev, sizeof(struct priv), GFP_KERNEL);
+	/// the private structure is not device managed because it must outlive
+	/// the device as long as a file is open
+	priv = kzalloc(sizeof(struct priv), GFP_KERNEL);
 	if (!priv) {
 		pr_err("[%s]: Error allocating private structure\n",
 		       DEVICE_NAME);
 		return -ENOMEM;
 	}
-	priv->is_open = false;
+	kref_init(&priv->refcount);
+	init_rwsem(&priv->running_lock);
+	mutex_init(&priv->players_lock);
+	priv->is_running = false;
+
+	/// from now on the private structure is freed by the release of the
+	/// char device, which comes after the last file is closed
+	device_initialize(&priv->device);
+	priv->device.release = drivify_device_release;
+	dev_set_drvdata(&priv->device, priv);
+	priv->dev = &priv->device;
 
 	platform_set_drvdata(pdev, priv);
 	dev_set_drvdata(&pdev->dev, priv);
 
-	res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
-	if (!res) {
-		pr_err("[%s]: Error getting resource\n", DEVICE_NAME);
-		return -ENODEV;
-	}
-
-	base_addr = devm_ioremap_resource(&pdev->dev, res);
-	if (!base_addr) {
-		pr_err("[%s]: Error mapping base address\n", DEVICE_NAME);
-		return -ENOMEM;
+	/// a simulated device gives its registers already mapped
+	pdata = dev_get_platdata(&pdev->dev);
+	if (pdata && pdata->regs) {
+		base_addr = pdata->regs;
+	} else {
+		res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
+		if (!res) {
+			pr_err("[%s]: Error getting resource\n", DEVICE_NAME);
+			goto ERR_REGS;
+		}
+
+		base_addr = devm_ioremap_resource(&pdev->dev, res);
+		if (IS_ERR(base_addr)) {
+			pr_err("[%s]: Error mapping base address\n",
+			       DEVICE_NAME);
+			goto ERR_REGS;
+		}
 	}
 
 	priv->regs = devm_kzalloc(&pdev->dev, sizeof(struct hw_registers),
@@ -265,7 +708,12 @@ static int drivify_probe(struct platform_device *pdev)
 	priv->regs->hex_0_3_reg = (uint8_t *)base_addr + HEX_OFFSET_0_3;
 	priv->regs->hex_4_5_reg = (uint8_t *)base_addr + HEX_OFFSET_4_5;
 	priv->regs->led_reg = (uint8_t *)base_addr + LED_OFFSET;
+	priv->regs->clear_keys_edge = keys_clear_edge_reg;
+	if (pdata && pdata->clear_keys_edge) {
+		priv->regs->clear_keys_edge = pdata->clear_keys_edge;
+	}
 
+	keys_input_init(&priv->keys_input);
 	err = setup_irq(priv, pdev);
 	if (err != 0) {
 		pr_err("[%s]: Failed to setup IRQ\n", DEVICE_NAME);
@@ -286,77 +734,61 @@ static int drivify_probe(struct platform_device *pdev)
 		goto ALLOC_CHRDEV;
 	}
 
-	priv->dev =
-		device_create(priv->cl, NULL, priv->majmin, priv, DEVICE_NAME);
-	if (!priv->dev) {
+	priv->device.class = priv->cl;
+	priv->device.devt = priv->majmin;
+	err = dev_set_name(&priv->device, DEVICE_NAME);
+	if (!err) {
+		err = device_add(&priv->device);
+	}
+	if (err) {
 		pr_err("[%s]: Error creating device\n", DEVICE_NAME);
 		goto ERR_DEVICE;
 	}
 
+	/// the default player exists before the device can be opened
+	err = add_player(priv);
+	if (err < 0) {
+		pr_err("[%s]: Error creating the default player\n",
+		       DEVICE_NAME);
+		goto ERR_PLAYER;
+	}
+
 	cdev_init(&priv->cdev, &drivify_fops);
+	/// an open file holds the char device, which holds the device
+	cdev_set_parent(&priv->cdev, &priv->device.kobj);
 	err = cdev_add(&priv->cdev, priv->majmin, 1);
 	if (err < 0) {
 		pr_err("[%s]: Adding char device failed\n", DEVICE_NAME);
 		goto ERR_CDEV_ADD;
 	}
 
-	priv->player =
-		devm_kzalloc(&pdev->dev, sizeof(struct player), GFP_KERNEL);
-	if (!priv->player) {
-		pr_err("[%s]: Error allocating kfifo\n", DEVICE_NAME);
-		goto ERR_PLAYER_ALLOC;
-	}
-
-	priv->player->playlist =
-		devm_kzalloc(&pdev->dev, sizeof(struct kfifo), GFP_KERNEL);
-
-	if (!priv->player->playlist) {
-		pr_err("[%s]: Error allocating playlist\n", DEVICE_NAME);
-		goto ERR_KFIFO_HEAD;
-	}
-
-	err = kfifo_alloc(priv->player->playlist,
-			  PLAYLIST_SIZE * sizeof(struct music), GFP_KERNEL);
-
-	pr_info("[%s]: Playlist initialized with %d elements\n", DEVICE_NAME,
-		kfifo_size(priv->player->playlist) / sizeof(struct music));
-
-	spin_lock_init(&priv->player->playlist_lock);
-
-	if (err) {
-		pr_err("[%s]: Error allocating kfifo\n", DEVICE_NAME);
-		goto ERR_KFIFO_FULL_ALLOC;
-	}
-
 	keys_enable_interrupts(priv->regs->keys_reg, USED_KEYS_MASK);
-	keys_clear_edge_reg(priv->regs->keys_reg, USED_KEYS_MASK);
-
-	priv->player->hex_reg = priv->regs->hex_0_3_reg;
-	priv->player->led_reg = priv->regs->led_reg;
-	initialize_player(priv->player);
+	priv->regs->clear_keys_edge(priv->regs->keys_reg, USED_KEYS_MASK);
 
+	priv->is_running = true;
 	init_drivify_sysfs(priv->dev);
 
 	pr_info("[%s]: Module ready!\n", DEVICE_NAME);
 	return 0;
 
 // error handling
-ERR_KFIFO_FULL_ALLOC:
-	kfifo_free(priv->player->playlist);
-ERR_KFIFO_HEAD:
-ERR_PLAYER_ALLOC:
-
 ERR_CDEV_ADD:
-	cdev_del(&priv->cdev);
-	device_destroy(priv->cl, priv->majmin);
+	stop_players(priv);
+ERR_PLAYER:
+	device_del(&priv->device);
 ERR_DEVICE:
 	unregister_chrdev_region(priv->majmin, 1);
 ALLOC_CHRDEV:
 	class_destroy(priv->cl);
 ERR_CLASS:
 	keys_disable_interrupts(priv->regs->keys_reg);
+	/// devres would only free the irq after priv, whose address is the
+	/// cookie of the handlers
+	devm_free_irq(&pdev->dev, priv->irq, priv);
 ERR_IRQ:
 ERR_REGS:
+	/// the players and the strings are freed with the private structure
+	put_device(&priv->device);
 	platform_driver_unregister(&drivify_driver);
 	return -1;
 }
@@ -376,41 +808,112 @@ static int drivify_remove(struct platform_device *pdev)
 
 	remove_drivify_sysfs(priv->dev);
 	keys_disable_interrupts(priv->regs->keys_reg);
-	stop_player(priv->player);
-	kfifo_free(priv->player->playlist);
+	// wait for the irq thread to apply the last presses before the player stops
+	devm_free_irq(&pdev->dev, priv->irq, priv);
+
+	/// the files still open stop using the player once is_running is false
+	down_write(&priv->running_lock);
+	priv->is_running = false;
+	up_write(&priv->running_lock);
+
+	/// the readers and writers blocked on a player are woken up
+	stop_players(priv);
 	cdev_del(&priv->cdev);
-	device_destroy(priv->cl, priv->majmin);
+	device_del(&priv->device);
 	class_destroy(priv->cl);
 	unregister_chrdev_region(priv->majmin, 1);
+	/// the private structure is freed once the last file is closed
+	put_device(&priv->device);
 	pr_info("[%s]: remove completed\n", DEVICE_NAME);
 
 	return 0;
 }
 
+static void drivify_free_priv(struct kref *refcount)
+{
+	struct priv *priv;
+
+	priv = container_of(refcount, struct priv, refcount);
+	pr_info("[%s]: Freeing private structure\n", DEVICE_NAME);
+	destroy_players(priv);
+	kfree(priv);
+}
+
+static void drivify_device_release(struct device *dev)
+{
+	struct priv *priv;
+
+	priv = container_of(dev, struct priv, device);
+	kref_put(&priv->refcount, drivify_free_priv);
+}
+
 static irqreturn_t irq_handler(int irq, void *dev_id)
 {
 	struct priv *priv;
-	uint8_t key_index;
+	uint8_t keys;
 
 	priv = (struct priv *)dev_id;
-	key_index = read_keys(priv->regs->keys_reg) & USED_KEYS_MASK;
-	pr_info("[%s]: Key %d pressed\n", DEVICE_NAME, key_index);
-	switch (key_index) {
-	case 1:
-		play_pause_song(priv->player);
+	keys = read_keys(priv->regs->keys_reg) & USED_KEYS_MASK;
+	priv->regs->clear_keys_edge(priv->regs->keys_reg, USED_KEYS_MASK);
+
+	if (keys == 0) {
+		return IRQ_NONE;
+	}
+
+	// if the queue is full the press is counted as dropped, the thread is
+	// woken up anyway to drain the queue
+	keys_queue_press(&priv->keys_input, keys);
+	return IRQ_WAKE_THREAD;
+}
+
+static irqreturn_t irq_thread(int irq, void *dev_id)
+{
+	struct priv *priv;
+	uint8_t keys;
+	int nb_dropped;
+
+	priv = (struct priv *)dev_id;
+
+	/// every key of every press is applied, simultaneous presses included
+	while (keys_next_press(&priv->keys_input, &keys)) {
+		for (uint8_t key = 0; key < NUM_KEYS; key++) {
+			if (keys & (1 << key)) {
+				handle_key(priv, key);
+			}
+		}
+	}
+
+	nb_dropped = atomic_xchg(&priv->keys_input.nb_dropped, 0);
+	if (nb_dropped > 0) {
+		pr_warn_ratelimited("[%s]: %d key presses dropped\n",
+				    DEVICE_NAME, nb_dropped);
+	}
+	return IRQ_HANDLED;
+}
+
+static void handle_key(struct priv *priv, uint8_t key)
+{
+	struct player *player;
+
+	pr_debug("[%s]: Key %d pressed\n", DEVICE_NAME, key);
+	player = get_keys_player(priv);
+	if (!player) {
+		return;
+	}
+
+	switch (key) {
+	case KEY_PLAY_PAUSE:
+		play_pause_song(player);
 		break;
-	case 2:
-		rewind_song(priv->player);
+	case KEY_REWIND:
+		rewind_song(player);
 		break;
-	case 4:
-		next_song(priv->player);
+	case KEY_NEXT:
+		next_song(player);
 		break;
 	default:
 		break;
 	}
-
-	keys_clear_edge_reg(priv->regs->keys_reg, USED_KEYS_MASK);
-	return IRQ_HANDLED;
 }
 
 static int setup_irq(struct priv *priv, struct platform_device *pdev)
@@ -425,12 +928,13 @@ static int setup_irq(struct priv *priv, struct platform_device *pdev)
 		return -EINVAL;
 	}
 
-	ret = devm_request_irq(&pdev->dev, irq_num, irq_handler, 0, "drivify",
-			       priv);
+	ret = devm_request_threaded_irq(&pdev->dev, irq_num, irq_handler,
+					irq_thread, 0, "drivify", priv);
 	if (ret < 0) {
 		pr_err("[%s]: Failed to request IRQ\n", DEVICE_NAME);
 		return ret;
 	}
+	priv->irq = irq_num;
 	return 0;
 }
 
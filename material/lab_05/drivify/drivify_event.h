@@ -0,0 +1,27 @@
+#ifndef DRIVIFY_EVENT_H
+#define DRIVIFY_EVENT_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#endif
+
+#define EVENT_TRACK 0x01 // The current track changed
+#define EVENT_STATE 0x02 // The player switched between play and pause
+#define EVENT_POSITION 0x04 // The position in the current track changed
+#define EVENT_LOST 0x80 // The reader was too slow, older events were dropped
+
+/// @brief Record returned by a read on /dev/drivify
+/// @note every record is a full snapshot of the player, flags only tell what
+/// changed since the previous record
+struct drivify_event {
+	uint32_t seq; // sequence number of the event
+	uint32_t position; // seconds played in the current track
+	uint32_t duration; // duration of the current track, 0 if none
+	uint8_t flags; // mask of EVENT_* values
+	uint8_t state; // 1 if playing, 0 if paused
+	uint16_t nb_songs; // number of songs including the current one, saturated
+};
+
+#endif // DRIVIFY_EVENT_H
@@ -0,0 +1,53 @@
+#ifndef DRIVIFY_IOCTL_H
+#define DRIVIFY_IOCTL_H
+
+#ifdef __KERNEL__
+#include <linux/ioctl.h>
+#include <linux/types.h>
+#else
+#include <sys/ioctl.h>
+#include <stdint.h>
+#endif
+#include "music.h"
+
+#define SNAPSHOT_MAGIC 0x56524444 // "DDRV" in little endian
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_MAX_SIZE (4 * 1024 * 1024)
+
+/// @brief Header of a playlist snapshot
+/// @note the header is followed by nb_songs music records as written on
+/// /dev/drivify (see music.h), the first one is the song being played if
+/// has_current is set
+struct snapshot_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t header_size; // size of the header, entries start right after
+	uint32_t total_size; // size of the header and all the entries
+	uint32_t nb_songs; // number of entries, the current song included
+	uint32_t position; // seconds played in the current song
+	uint8_t has_current; // 1 if the first entry is the current song
+	uint8_t state; // 1 if playing, 0 if paused
+	uint16_t reserved;
+};
+
+/// @brief Buffer given to the snapshot ioctls
+struct drivify_snapshot {
+	uint64_t addr; // address of the snapshot in user space
+	uint32_t size; // size of the buffer, set to the snapshot size on export
+	uint32_t reserved;
+};
+
+#define DRIVIFY_IOC_MAGIC 'd'
+/// export the playlist, fails with ENOSPC if the buffer is too small, the
+/// size needed is then given back in the size field, and with E2BIG if the
+/// snapshot would exceed SNAPSHOT_MAX_SIZE
+#define DRIVIFY_IOC_EXPORT _IOWR(DRIVIFY_IOC_MAGIC, 0, struct drivify_snapshot)
+/// replace the playlist, the current song and its position in one shot
+#define DRIVIFY_IOC_IMPORT _IOW(DRIVIFY_IOC_MAGIC, 1, struct drivify_snapshot)
+/// create a new player, its number is given back
+#define DRIVIFY_IOC_ADD_PLAYER _IOR(DRIVIFY_IOC_MAGIC, 2, uint32_t)
+/// select the player used by the file for the songs, the events and the
+/// snapshots, fails with EBUSY while a song is partially written
+#define DRIVIFY_IOC_SELECT_PLAYER _IOW(DRIVIFY_IOC_MAGIC, 3, uint32_t)
+
+#endif // DRIVIFY_IOCTL_H
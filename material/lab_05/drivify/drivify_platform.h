@@ -0,0 +1,23 @@
+#ifndef DRIVIFY_PLATFORM_H
+#define DRIVIFY_PLATFORM_H
+
+#include "led.h"
+#include <linux/types.h>
+
+#define DRIVIFY_DRIVER_NAME "drivify"
+#define HEX_OFFSET_0_3 0x20
+#define HEX_OFFSET_4_5 0x30
+#define DRIVIFY_REGS_SIZE 0x60 // up to the end of the keys registers
+
+///@brief the platform data given by a device without memory resource
+///@note the simulation module (drivify_sim.c) uses it to give registers
+/// in RAM, the real board describes its registers in the device tree
+struct drivify_platform_data {
+	void __iomem *regs; // already mapped registers
+	///@brief acknowledges key edges, the RAM cannot clear on write
+	///@param keys_reg the keys registers
+	///@param key_mask the edges to clear
+	void (*clear_keys_edge)(void __iomem *keys_reg, uint8_t key_mask);
+};
+
+#endif // DRIVIFY_PLATFORM_H
@@ -1,27 +1,66 @@
 #ifndef DRIVIFY_SHARED_TYPES_H
 #define DRIVIFY_SHARED_TYPES_H
 #include <linux/kfifo.h>
+#include "playlist.h"
+#include "shadow.h"
 #include <linux/spinlock.h>
 #include <linux/cdev.h>
+#include <linux/kref.h>
+#include <linux/rwsem.h>
+#include <linux/mutex.h>
+#include "events.h"
+#include "keys.h"
+#include "strpool.h"
+
+#define DRIVIFY_MAX_PLAYERS 8
+
+#define OUTPUT_HEX 0x01 // the player drives the hex displays
+#define OUTPUT_LEDS 0x02 // the player drives the leds
+#define OUTPUT_KEYS 0x04 // the keys control the player
+#define OUTPUT_ALL (OUTPUT_HEX | OUTPUT_LEDS | OUTPUT_KEYS)
+
+///@brief the structure of the hardware registers
+struct hw_registers {
+	void __iomem *keys_reg;
+	void __iomem *hex_0_3_reg;
+	void __iomem *hex_4_5_reg;
+	void __iomem *led_reg;
+	// keys_clear_edge_reg unless the registers are simulated
+	void (*clear_keys_edge)(void __iomem *keys_reg, uint8_t key_mask);
+};
 
 ///@brief the private structure of the device
 struct priv {
 	struct class *cl;
-	struct device *dev;
-	struct cdev cdev;
+	struct device *dev; // points to device
+	struct device device; // its release drops the reference of the device
+	struct cdev cdev; // holds a reference on device until the last file is closed
 	struct hw_registers *regs;
-	struct player *player;
+	struct player *players[DRIVIFY_MAX_PLAYERS]; // the first one is the default player
+	unsigned int nb_players; // players are only added, never removed before the device
+	struct mutex players_lock; // serializes the creation and the routing of the players
+	struct keys_input keys_input;
+	int irq;
 	dev_t majmin;
-	bool is_open;
+	struct kref refcount; // one reference for the device and one per open file
+	struct rw_semaphore running_lock; // protects is_running
 	bool is_running;
 };
 
 struct player {
-	struct kfifo *playlist;
+	unsigned int id;
+	struct priv *priv; // device of the player
+	struct kobject *kobj; // sysfs directory of the player
+	atomic_t outputs; // mask of OUTPUT_* routed to the player
+	struct playlist *playlist;
+	struct str_pool pool; // titles and artists of the songs of this player only
 	void *__iomem hex_reg;
 	void *__iomem led_reg;
+	struct shadow_reg hex_shadow; // only written by the player thread
+	struct shadow_reg led_shadow; // only written by the player thread
 	void *data;
-	spinlock_t playlist_lock;
+	struct stat_spinlock queue_lock; // protects the playlist only
+	struct event_log events;
 };
 
 #endif // DRIVIFY_SHARED_TYPES_H
@@ -0,0 +1,275 @@
+#include "drivify_platform.h"
+#include "keys.h"
+#include <linux/debugfs.h>
+#include <linux/init.h>
+#include <linux/interrupt.h>
+#include <linux/io.h>
+#include <linux/irq.h>
+#include <linux/irq_sim.h>
+#include <linux/irqdomain.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
+
+#define SIM_NAME "drivify_sim"
+#define SIM_MAX_PRESSES 100000 // per write
+#define SIM_ACK_TIMEOUT_MS 100
+
+///@brief the simulated board, there is only one
+struct drivify_sim {
+	void *regs; // the registers in RAM
+	struct irq_domain *domain;
+	int irq;
+	struct platform_device *pdev;
+	struct dentry *debugfs;
+	spinlock_t edge_lock; // protects the edge capture register
+	wait_queue_head_t ack_wait; // woken up when the driver clears edges
+	atomic_t nb_injected;
+	atomic_t nb_acked;
+	atomic_t nb_timeouts;
+};
+
+static struct drivify_sim sim;
+
+///@brief clears the edges like the hardware does when 1 is written on them
+///@param keys_reg the keys registers
+///@param key_mask the edges to clear
+///@note called by the driver in hard irq context
+static void sim_clear_keys_edge(void __iomem *keys_reg, uint8_t key_mask);
+
+///@brief latches a press in the edge register and raises the irq if the
+/// driver enabled it for these keys
+///@param key_mask the keys pressed
+///@return true if the irq has been raised
+static bool sim_press_keys(uint8_t key_mask);
+
+///@brief tells if the driver has acknowledged the edges of a press
+///@param key_mask the keys of the press
+///@return true if none of these edges is still set
+static bool sim_edges_cleared(uint8_t key_mask);
+
+///@brief injects presses written as "<mask> [count]" in the keys file
+///@param filp the debugfs file
+///@param buf the user buffer
+///@param count the size of the buffer
+///@param ppos the position in the file
+///@return count or a negative error
+///@note each press waits for the driver to acknowledge the previous one then
+/// no press is merged with another in the edge register
+static ssize_t sim_keys_write(struct file *filp, const char __user *buf,
+			      size_t count, loff_t *ppos);
+
+///@brief shows the registers and the injection counters
+///@param s the seq file
+///@param unused unused
+///@return 0
+static int sim_regs_show(struct seq_file *s, void *unused);
+
+static void sim_clear_keys_edge(void __iomem *keys_reg, uint8_t key_mask)
+{
+	void __iomem *edge_reg;
+	unsigned long flags;
+	uint8_t edges;
+
+	edge_reg = keys_reg + KEYS_EDGE_OFFSET;
+	spin_lock_irqsave(&sim.edge_lock, flags);
+	edges = ioread8(edge_reg);
+	iowrite8(edges & ~key_mask, edge_reg);
+	spin_unlock_irqrestore(&sim.edge_lock, flags);
+
+	if (edges & key_mask) {
+		atomic_inc(&sim.nb_acked);
+		wake_up(&sim.ack_wait);
+	}
+}
+
+static bool sim_press_keys(uint8_t key_mask)
+{
+	void __iomem *keys_reg;
+	unsigned long flags;
+	uint8_t irq_mask;
+
+	keys_reg = (void __iomem *)sim.regs + KEYS_OFFSET;
+	spin_lock_irqsave(&sim.edge_lock, flags);
+	iowrite8(ioread8(keys_reg + KEYS_EDGE_OFFSET) | key_mask,
+		 keys_reg + KEYS_EDGE_OFFSET);
+	irq_mask = ioread8(keys_reg + KEYS_IRQ_OFFSET);
+	spin_unlock_irqrestore(&sim.edge_lock, flags);
+
+	atomic_inc(&sim.nb_injected);
+	if (!(irq_mask & key_mask)) {
+		return false;
+	}
+
+	irq_set_irqchip_state(sim.irq, IRQCHIP_STATE_PENDING, true);
+	return true;
+}
+
+static bool sim_edges_cleared(uint8_t key_mask)
+{
+	void __iomem *edge_reg;
+
+	edge_reg = (void __iomem *)sim.regs + KEYS_OFFSET + KEYS_EDGE_OFFSET;
+	return !(ioread8(edge_reg) & key_mask);
+}
+
+static ssize_t sim_keys_write(struct file *filp, const char __user *buf,
+			      size_t count, loff_t *ppos)
+{
+	char kbuf[32];
+	unsigned int mask;
+	unsigned int nb_presses;
+	unsigned int i;
+	long remaining;
+
+	if (count >= sizeof(kbuf)) {
+		return -EINVAL;
+	}
+	if (copy_from_user(kbuf, buf, count)) {
+		return -EFAULT;
+	}
+	kbuf[count] = '\0';
+
+	nb_presses = 1;
+	if (sscanf(kbuf, "%i %u", &mask, &nb_presses) < 1) {
+		return -EINVAL;
+	}
+	if (mask == 0 || mask > KEYS_MASK || nb_presses == 0 ||
+	    nb_presses > SIM_MAX_PRESSES) {
+		return -EINVAL;
+	}
+
+	for (i = 0; i < nb_presses; i++) {
+		if (!sim_press_keys(mask)) {
+			continue;
+		}
+
+		remaining = wait_event_interruptible_timeout(
+			sim.ack_wait, sim_edges_cleared(mask),
+			msecs_to_jiffies(SIM_ACK_TIMEOUT_MS));
+		if (remaining < 0) {
+			return remaining;
+		}
+		if (remaining == 0) {
+			atomic_inc(&sim.nb_timeouts);
+		}
+	}
+
+	return count;
+}
+
+static int sim_regs_show(struct seq_file *s, void *unused)
+{
+	void __iomem *regs;
+
+	regs = (void __iomem *)sim.regs;
+	seq_printf(s, "leds: 0x%03x\n", ioread32(regs + LED_OFFSET));
+	seq_printf(s, "hex_0_3: 0x%08x\n", ioread32(regs + HEX_OFFSET_0_3));
+	seq_printf(s, "hex_4_5: 0x%08x\n", ioread32(regs + HEX_OFFSET_4_5));
+	seq_printf(s, "keys_irq_mask: 0x%x\n",
+		   ioread8(regs + KEYS_OFFSET + KEYS_IRQ_OFFSET));
+	seq_printf(s, "keys_edges: 0x%x\n",
+		   ioread8(regs + KEYS_OFFSET + KEYS_EDGE_OFFSET));
+	seq_printf(s, "injected: %d\n", atomic_read(&sim.nb_injected));
+	seq_printf(s, "acked: %d\n", atomic_read(&sim.nb_acked));
+	seq_printf(s, "timeouts: %d\n", atomic_read(&sim.nb_timeouts));
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(sim_regs);
+
+static const struct file_operations sim_keys_fops = {
+	.owner = THIS_MODULE,
+	.write = sim_keys_write,
+};
+
+static int __init drivify_sim_init(void)
+{
+	struct drivify_platform_data pdata;
+	struct platform_device_info info;
+	struct resource irq_res;
+	int err;
+
+	pr_info("[%s]: Initializing\n", SIM_NAME);
+	spin_lock_init(&sim.edge_lock);
+	init_waitqueue_head(&sim.ack_wait);
+	atomic_set(&sim.nb_injected, 0);
+	atomic_set(&sim.nb_acked, 0);
+	atomic_set(&sim.nb_timeouts, 0);
+
+	sim.regs = kzalloc(DRIVIFY_REGS_SIZE, GFP_KERNEL);
+	if (!sim.regs) {
+		return -ENOMEM;
+	}
+
+	sim.domain = irq_domain_create_sim(NULL, 1);
+	if (IS_ERR(sim.domain)) {
+		pr_err("[%s]: Error creating the simulated irq\n", SIM_NAME);
+		err = PTR_ERR(sim.domain);
+		goto ERR_DOMAIN;
+	}
+
+	sim.irq = irq_create_mapping(sim.domain, 0);
+	if (!sim.irq) {
+		pr_err("[%s]: Error mapping the simulated irq\n", SIM_NAME);
+		err = -ENXIO;
+		goto ERR_MAPPING;
+	}
+
+	/// the platform data is copied by the platform device
+	pdata.regs = (void __iomem *)sim.regs;
+	pdata.clear_keys_edge = sim_clear_keys_edge;
+	irq_res = (struct resource)DEFINE_RES_IRQ(sim.irq);
+	memset(&info, 0, sizeof(info));
+	info.name = DRIVIFY_DRIVER_NAME;
+	info.id = PLATFORM_DEVID_NONE;
+	info.res = &irq_res;
+	info.num_res = 1;
+	info.data = &pdata;
+	info.size_data = sizeof(pdata);
+
+	sim.pdev = platform_device_register_full(&info);
+	if (IS_ERR(sim.pdev)) {
+		pr_err("[%s]: Error registering the device\n", SIM_NAME);
+		err = PTR_ERR(sim.pdev);
+		goto ERR_DEVICE;
+	}
+
+	sim.debugfs = debugfs_create_dir(SIM_NAME, NULL);
+	debugfs_create_file("keys", 0200, sim.debugfs, NULL, &sim_keys_fops);
+	debugfs_create_file("regs", 0444, sim.debugfs, NULL, &sim_regs_fops);
+
+	pr_info("[%s]: Simulated device registered on irq %d\n", SIM_NAME,
+		sim.irq);
+	return 0;
+
+ERR_DEVICE:
+	irq_dispose_mapping(sim.irq);
+ERR_MAPPING:
+	irq_domain_remove_sim(sim.domain);
+ERR_DOMAIN:
+	kfree(sim.regs);
+	return err;
+}
+
+static void __exit drivify_sim_exit(void)
+{
+	pr_info("[%s]: Exiting\n", SIM_NAME);
+	/// the injections in progress end before the device is removed
+	debugfs_remove_recursive(sim.debugfs);
+	platform_device_unregister(sim.pdev);
+	irq_dispose_mapping(sim.irq);
+	irq_domain_remove_sim(sim.domain);
+	kfree(sim.regs);
+}
+
+module_init(drivify_sim_init);
+module_exit(drivify_sim_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Alexandre Iorio");
+MODULE_DESCRIPTION("Drivify - simulated board");
@@ -0,0 +1,530 @@
+#include "drivify_event.h"
+#include "music.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define USAGE                                                                  \
+	"Usage: %s [-w writers] [-n songs per writer] [-s sysfs threads]\n"    \
+	"          [-i sysfs iterations] [-k key presses] [-l latency samples]\n"
+#define DEVICE_NAME "/dev/drivify"
+#define SYSFS_DIR "/sys/class/drivify/drivify/"
+#define KEYS_INJECT_PATH "/sys/kernel/debug/drivify_sim/keys"
+#define SIM_REGS_PATH "/sys/kernel/debug/drivify_sim/regs"
+#define LOCK_STATS_PATH "/sys/kernel/debug/drivify/locks"
+#define REPORT_VERSION 1
+#define SONGS_PER_WRITE 16
+#define SONG_DURATION 180
+#define KEY_NEXT_MASK 0x4
+#define KEYS_PER_WRITE 100
+#define LATENCY_TIMEOUT_MS 1000
+#define NB_EVENTS 16
+
+/// @brief latencies of one kind of operation, in nanoseconds
+struct samples {
+	uint64_t *values;
+	size_t nb;
+	size_t capacity;
+};
+
+/// @brief the options of the run
+struct config {
+	int nb_writers;
+	int nb_songs;
+	int nb_sysfs_threads;
+	int nb_sysfs_iterations;
+	int nb_key_presses;
+	int nb_latency_samples;
+};
+
+/// @brief the work and the results of one thread
+struct worker {
+	pthread_t thread;
+	int id;
+	const struct config *config;
+	struct samples samples;
+	long nb_done;
+	long nb_errors;
+	size_t nb_bytes;
+};
+
+/// @brief Get a monotonic time
+/// @return the time in nanoseconds
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/// @brief Allocate room for the samples
+/// @param samples the samples to initialize
+/// @param capacity the maximal number of samples
+/// @return 0 if no error
+static int init_samples(struct samples *samples, size_t capacity)
+{
+	samples->nb = 0;
+	samples->capacity = capacity;
+	samples->values = calloc(capacity ? capacity : 1, sizeof(uint64_t));
+	return samples->values ? 0 : -1;
+}
+
+/// @brief Add a sample, it is ignored once the samples are full
+/// @param samples the samples
+/// @param value the latency in nanoseconds
+static void add_sample(struct samples *samples, uint64_t value)
+{
+	if (samples->nb < samples->capacity) {
+		samples->values[samples->nb++] = value;
+	}
+}
+
+/// @brief Move the samples of a thread into the global samples
+/// @param dst the global samples
+/// @param src the samples of the thread, freed
+static void merge_samples(struct samples *dst, struct samples *src)
+{
+	for (size_t i = 0; i < src->nb; i++) {
+		add_sample(dst, src->values[i]);
+	}
+	free(src->values);
+	src->values = NULL;
+}
+
+/// @brief Order two samples for qsort
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/// @brief Print min, average, percentiles and max of the samples in us
+/// @param name the prefix of the report lines
+/// @param samples the samples, sorted by this function
+static void report_samples(const char *name, struct samples *samples)
+{
+	uint64_t sum = 0;
+	size_t nb = samples->nb;
+
+	printf("%s.samples %zu\n", name, nb);
+	if (nb == 0) {
+		return;
+	}
+
+	qsort(samples->values, nb, sizeof(uint64_t), compare_u64);
+	for (size_t i = 0; i < nb; i++) {
+		sum += samples->values[i];
+	}
+	printf("%s.min_us %.1f\n", name, samples->values[0] / 1000.0);
+	printf("%s.avg_us %.1f\n", name, sum / (double)nb / 1000.0);
+	printf("%s.p50_us %.1f\n", name, samples->values[nb / 2] / 1000.0);
+	printf("%s.p99_us %.1f\n", name,
+	       samples->values[(nb * 99) / 100] / 1000.0);
+	printf("%s.max_us %.1f\n", name, samples->values[nb - 1] / 1000.0);
+}
+
+/// @brief Write a whole string in a file
+/// @param path the file
+/// @param value the string
+/// @return 0 if no error
+static int write_file(const char *path, const char *value)
+{
+	ssize_t len = strlen(value);
+	int fd;
+	int ret;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	ret = write(fd, value, len) == len ? 0 : -1;
+	close(fd);
+	return ret;
+}
+
+/// @brief Read a small file in a buffer
+/// @param path the file
+/// @param buf the buffer, null terminated
+/// @param size the size of the buffer
+/// @return the number of bytes read or -1
+static ssize_t read_file(const char *path, char *buf, size_t size)
+{
+	ssize_t nb_read;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	nb_read = read(fd, buf, size - 1);
+	close(fd);
+	if (nb_read >= 0) {
+		buf[nb_read] = '\0';
+	}
+	return nb_read;
+}
+
+/// @brief Copy a text file of the kernel in the report
+/// @param name the section of the report
+/// @param path the file
+static void report_file(const char *name, const char *path)
+{
+	char buf[4096];
+	char *line;
+	char *saveptr;
+
+	if (read_file(path, buf, sizeof(buf)) < 0) {
+		printf("%s unavailable\n", name);
+		return;
+	}
+	for (line = strtok_r(buf, "\n", &saveptr); line;
+	     line = strtok_r(NULL, "\n", &saveptr)) {
+		printf("%s.%s\n", name, line);
+	}
+}
+
+/// @brief Build the records of a batch of songs
+/// @param buf the buffer of SONGS_PER_WRITE records
+/// @param writer the id of the writer
+/// @param first the index of the first song
+/// @param nb the number of songs
+/// @return the size of the batch
+static size_t build_songs(uint8_t *buf, int writer, int first, int nb)
+{
+	struct music music;
+	char title[NAME_SIZE];
+	char artist[ARTIST_SIZE];
+	size_t len = 0;
+
+	for (int i = 0; i < nb; i++) {
+		music.duration = SONG_DURATION;
+		music.name_len = snprintf(title, sizeof(title), "stress %d-%d",
+					  writer, first + i);
+		// a few artists to exercise the sharing of the strings
+		music.artist_len = snprintf(artist, sizeof(artist),
+					    "artist %d", (first + i) % 8);
+		memcpy(buf + len, &music, sizeof(music));
+		len += sizeof(music);
+		memcpy(buf + len, title, music.name_len);
+		len += music.name_len;
+		memcpy(buf + len, artist, music.artist_len);
+		len += music.artist_len;
+	}
+	return len;
+}
+
+/// @brief Upload songs by batches, each write is a sample
+/// @param arg the worker
+/// @return NULL
+static void *upload_thread(void *arg)
+{
+	struct worker *worker = arg;
+	uint8_t *buf;
+	int nb_songs = worker->config->nb_songs;
+	uint64_t start;
+	ssize_t nb_written;
+	size_t len;
+	int fd;
+
+	// a paused player never frees the budget, a blocking write could wait
+	// forever instead of reporting
+	buf = malloc(SONGS_PER_WRITE * MUSIC_RECORD_MAX_SIZE);
+	fd = open(DEVICE_NAME, O_WRONLY | O_NONBLOCK);
+	if (!buf || fd < 0) {
+		worker->nb_errors++;
+		if (fd >= 0) {
+			close(fd);
+		}
+		free(buf);
+		return NULL;
+	}
+
+	for (int i = 0; i < nb_songs; i += SONGS_PER_WRITE) {
+		int nb = nb_songs - i < SONGS_PER_WRITE ? nb_songs - i :
+							  SONGS_PER_WRITE;
+
+		len = build_songs(buf, worker->id, i, nb);
+		start = now_ns();
+		nb_written = write(fd, buf, len);
+		add_sample(&worker->samples, now_ns() - start);
+		if (nb_written != (ssize_t)len) {
+			// a partial write or EAGAIN means the budget is reached
+			worker->nb_errors++;
+			break;
+		}
+		worker->nb_done += nb;
+		worker->nb_bytes += len;
+	}
+
+	close(fd);
+	free(buf);
+	return NULL;
+}
+
+/// @brief Alternate control writes and status reads on the sysfs attributes
+/// @param arg the worker
+/// @return NULL
+static void *sysfs_thread(void *arg)
+{
+	static const char *const reads[] = {
+		SYSFS_DIR "drivify_playlist_total_songs",
+		SYSFS_DIR "drivify_playlist_total_duration",
+		SYSFS_DIR "drivify_commands_stats",
+		SYSFS_DIR "drivify_time_cmd",
+	};
+	struct worker *worker = arg;
+	char buf[256];
+	uint64_t start;
+	int ret;
+
+	for (int i = 0; i < worker->config->nb_sysfs_iterations; i++) {
+		start = now_ns();
+		if (i % 2 == 0) {
+			ret = write_file(SYSFS_DIR "drivify_play_cmd",
+					 (i / 2 + worker->id) % 2 ? "1" : "0");
+		} else {
+			ret = read_file(reads[(i / 2) % 4], buf, sizeof(buf));
+		}
+		add_sample(&worker->samples, now_ns() - start);
+		if (ret < 0) {
+			worker->nb_errors++;
+		} else {
+			worker->nb_done++;
+		}
+	}
+	return NULL;
+}
+
+/// @brief Run a phase on several threads and report its samples
+/// @param name the name of the phase in the report
+/// @param config the options
+/// @param nb_threads the number of threads
+/// @param nb_samples the maximal number of samples of a thread
+/// @param routine the body of the threads
+/// @return 0 if no error
+static int run_phase(const char *name, const struct config *config,
+		     int nb_threads, size_t nb_samples,
+		     void *(*routine)(void *))
+{
+	struct worker *workers;
+	struct samples samples;
+	long nb_done = 0;
+	long nb_errors = 0;
+	size_t nb_bytes = 0;
+	uint64_t start;
+	double elapsed;
+	char prefix[64];
+
+	workers = calloc(nb_threads, sizeof(struct worker));
+	if (!workers ||
+	    init_samples(&samples, nb_samples * (size_t)nb_threads) < 0) {
+		free(workers);
+		return -1;
+	}
+
+	start = now_ns();
+	for (int i = 0; i < nb_threads; i++) {
+		workers[i].id = i;
+		workers[i].config = config;
+		init_samples(&workers[i].samples, nb_samples);
+		pthread_create(&workers[i].thread, NULL, routine, &workers[i]);
+	}
+	for (int i = 0; i < nb_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		nb_done += workers[i].nb_done;
+		nb_errors += workers[i].nb_errors;
+		nb_bytes += workers[i].nb_bytes;
+		merge_samples(&samples, &workers[i].samples);
+	}
+	elapsed = (now_ns() - start) / 1e9;
+
+	printf("%s.threads %d\n", name, nb_threads);
+	printf("%s.done %ld\n", name, nb_done);
+	printf("%s.errors %ld\n", name, nb_errors);
+	printf("%s.elapsed_s %.3f\n", name, elapsed);
+	printf("%s.per_s %.1f\n", name, nb_done / elapsed);
+	if (nb_bytes) {
+		printf("%s.bytes_per_s %.1f\n", name, nb_bytes / elapsed);
+	}
+	snprintf(prefix, sizeof(prefix), "%s.op", name);
+	report_samples(prefix, &samples);
+
+	free(samples.values);
+	free(workers);
+	return 0;
+}
+
+/// @brief Inject "next" presses through the simulated board
+/// @param config the options
+static void run_keys(const struct config *config)
+{
+	char cmd[32];
+	int nb_left = config->nb_key_presses;
+	uint64_t start;
+	double elapsed;
+
+	if (access(KEYS_INJECT_PATH, W_OK) != 0) {
+		printf("keys unavailable\n");
+		return;
+	}
+
+	start = now_ns();
+	while (nb_left > 0) {
+		int nb = nb_left < KEYS_PER_WRITE ? nb_left : KEYS_PER_WRITE;
+
+		snprintf(cmd, sizeof(cmd), "%d %d", KEY_NEXT_MASK, nb);
+		if (write_file(KEYS_INJECT_PATH, cmd) < 0) {
+			printf("keys.error %s\n", strerror(errno));
+			break;
+		}
+		nb_left -= nb;
+	}
+	elapsed = (now_ns() - start) / 1e9;
+
+	printf("keys.presses %d\n", config->nb_key_presses - nb_left);
+	printf("keys.elapsed_s %.3f\n", elapsed);
+	printf("keys.per_s %.1f\n",
+	       (config->nb_key_presses - nb_left) / elapsed);
+	report_file("keys.sim", SIM_REGS_PATH);
+}
+
+/// @brief Wait for an event telling that the player has the given state
+/// @param fd the event stream
+/// @param state the expected state
+/// @return 0 when the event arrives, -1 after LATENCY_TIMEOUT_MS
+static int wait_state(int fd, int state)
+{
+	struct drivify_event events[NB_EVENTS];
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	ssize_t nb_read;
+
+	while (poll(&pfd, 1, LATENCY_TIMEOUT_MS) > 0) {
+		nb_read = read(fd, events, sizeof(events));
+		for (int i = 0; i < nb_read / (ssize_t)sizeof(events[0]); i++) {
+			if ((events[i].flags & EVENT_STATE) &&
+			    events[i].state == state) {
+				return 0;
+			}
+		}
+	}
+	return -1;
+}
+
+/// @brief Measure the time between a play/pause command and its event
+/// @param config the options
+static void run_latency(const struct config *config)
+{
+	struct drivify_event events[NB_EVENTS];
+	struct samples samples;
+	char buf[16];
+	int nb_timeouts = 0;
+	int state;
+	uint64_t start;
+	int fd;
+
+	if (read_file(SYSFS_DIR "drivify_play_cmd", buf, sizeof(buf)) < 0 ||
+	    init_samples(&samples, config->nb_latency_samples) < 0) {
+		printf("latency unavailable\n");
+		return;
+	}
+	state = atoi(buf);
+
+	fd = open(DEVICE_NAME, O_RDONLY | O_NONBLOCK);
+	if (fd < 0) {
+		printf("latency unavailable\n");
+		free(samples.values);
+		return;
+	}
+	// the events before the first command are ignored
+	while (read(fd, events, sizeof(events)) > 0) {
+	}
+
+	for (int i = 0; i < config->nb_latency_samples; i++) {
+		state = !state;
+		start = now_ns();
+		if (write_file(SYSFS_DIR "drivify_play_cmd",
+			       state ? "1" : "0") < 0 ||
+		    wait_state(fd, state) < 0) {
+			nb_timeouts++;
+			continue;
+		}
+		add_sample(&samples, now_ns() - start);
+	}
+
+	printf("latency.timeouts %d\n", nb_timeouts);
+	report_samples("latency.command_to_event", &samples);
+	free(samples.values);
+	close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+	struct config config = {
+		.nb_writers = 4,
+		.nb_songs = 1000,
+		.nb_sysfs_threads = 4,
+		.nb_sysfs_iterations = 1000,
+		.nb_key_presses = 1000,
+		.nb_latency_samples = 100,
+	};
+	int opt;
+
+	while ((opt = getopt(argc, argv, "w:n:s:i:k:l:")) != -1) {
+		switch (opt) {
+		case 'w':
+			config.nb_writers = atoi(optarg);
+			break;
+		case 'n':
+			config.nb_songs = atoi(optarg);
+			break;
+		case 's':
+			config.nb_sysfs_threads = atoi(optarg);
+			break;
+		case 'i':
+			config.nb_sysfs_iterations = atoi(optarg);
+			break;
+		case 'k':
+			config.nb_key_presses = atoi(optarg);
+			break;
+		case 'l':
+			config.nb_latency_samples = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, USAGE, argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (config.nb_writers < 0 || config.nb_songs < 0 ||
+	    config.nb_sysfs_threads < 0 || config.nb_sysfs_iterations < 0 ||
+	    config.nb_key_presses < 0 || config.nb_latency_samples < 0) {
+		fprintf(stderr, USAGE, argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (access(DEVICE_NAME, R_OK | W_OK) != 0) {
+		perror("Failed to access " DEVICE_NAME);
+		return EXIT_FAILURE;
+	}
+
+	// one "name value" line per metric, easy to diff between versions
+	printf("report.version %d\n", REPORT_VERSION);
+	run_phase("upload", &config, config.nb_writers,
+		  (config.nb_songs + SONGS_PER_WRITE - 1) / SONGS_PER_WRITE,
+		  upload_thread);
+	run_phase("sysfs", &config, config.nb_sysfs_threads,
+		  config.nb_sysfs_iterations, sysfs_thread);
+	run_keys(&config);
+	run_latency(&config);
+	report_file("locks", LOCK_STATS_PATH);
+
+	return 0;
+}
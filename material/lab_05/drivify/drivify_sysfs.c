@@ -1,110 +1,177 @@
 #include "drivify_sysfs.h"
 #include "linux/device.h"
 #include "player.h"
+#include "players.h"
+#include <linux/kobject.h>
+#include <linux/slab.h>
 
 #define LIB_NAME "drivify_sysfs"
 
-static ssize_t drivify_current_title_show(struct device *dev,
-					  struct device_attribute *attr,
-					  char *buf)
+///@brief an attribute of the directory of a player
+struct player_attribute {
+	struct attribute attr;
+	ssize_t (*show)(struct player *player, char *buf);
+	ssize_t (*store)(struct player *player, const char *buf,
+			 size_t count);
+};
+
+///@brief the directory of a player
+struct player_kobj {
+	struct kobject kobj;
+	struct player *player;
+};
+
+static const char *const OUTPUT_NAMES[] = { "hex", "leds", "keys" };
+
+static ssize_t current_title_show(struct player *player, char *buf)
 {
-	struct music current_song;
-	struct priv *priv;
-	priv = (struct priv *)dev_get_drvdata(dev);
+	struct song current_song;
+	ssize_t ret;
 
-	get_current_song(priv->player, &current_song);
+	get_current_song(player, &current_song);
 
-	if (current_song.name[0] == '\0') {
-		return sprintf(buf, "No song is playing\n");
+	if (current_song.duration == 0) {
+		ret = sprintf(buf, "No song is playing\n");
+	} else {
+		ret = sprintf(buf, "%s\n", song_name(&current_song));
 	}
 
-	return sprintf(buf, "%s\n", current_song.name);
+	release_song(&player->pool, &current_song);
+	return ret;
 }
 
-static ssize_t drivify_current_artist_show(struct device *dev,
-					   struct device_attribute *attr,
-					   char *buf)
+static ssize_t current_artist_show(struct player *player, char *buf)
 {
-	struct music current_song;
-	struct priv *priv;
-	priv = (struct priv *)dev_get_drvdata(dev);
+	struct song current_song;
+	ssize_t ret;
 
-	get_current_song(priv->player, &current_song);
+	get_current_song(player, &current_song);
 
-	if (current_song.artist[0] == '\0') {
-		return sprintf(buf, "No song is playing\n");
+	if (current_song.duration == 0) {
+		ret = sprintf(buf, "No song is playing\n");
+	} else {
+		ret = sprintf(buf, "%s\n", song_artist(&current_song));
 	}
 
-	return sprintf(buf, "%s\n", current_song.artist);
+	release_song(&player->pool, &current_song);
+	return ret;
 }
 
-static ssize_t drivify_current_duration_show(struct device *dev,
-					     struct device_attribute *attr,
-					     char *buf)
+static ssize_t current_duration_show(struct player *player, char *buf)
 {
-	struct music current_song;
-	struct priv *priv;
-	priv = (struct priv *)dev_get_drvdata(dev);
+	struct song current_song;
+	ssize_t ret;
 
-	get_current_song(priv->player, &current_song);
+	get_current_song(player, &current_song);
 
 	if (current_song.duration == 0) {
-		return sprintf(buf, "No song is playing\n");
+		ret = sprintf(buf, "No song is playing\n");
+	} else {
+		ret = sprintf(buf, "%d\n", current_song.duration);
 	}
 
-	return sprintf(buf, "%d\n", current_song.duration);
+	release_song(&player->pool, &current_song);
+	return ret;
 }
 
-static ssize_t drivify_playlist_total_songs_show(struct device *dev,
-						 struct device_attribute *attr,
-						 char *buf)
+static ssize_t playlist_total_songs_show(struct player *player, char *buf)
 {
-	uint8_t nb_songs;
-	struct priv *priv;
-	priv = (struct priv *)dev_get_drvdata(dev);
+	uint32_t nb_songs;
 
-	get_nb_songs(priv->player, &nb_songs);
+	get_nb_songs(player, &nb_songs);
 
-	return sprintf(buf, "%d\n", nb_songs);
+	return sprintf(buf, "%u\n", nb_songs);
 }
 
-static ssize_t
-drivify_playlist_total_duration_show(struct device *dev,
-				     struct device_attribute *attr, char *buf)
+static ssize_t playlist_total_duration_show(struct player *player, char *buf)
 {
 	uint32_t total_duration;
-	struct priv *priv;
-	priv = (struct priv *)dev_get_drvdata(dev);
 
-	get_total_duration(priv->player, &total_duration);
+	get_total_duration(player, &total_duration);
 
 	return sprintf(buf, "%d\n", total_duration);
 }
 
-static ssize_t drivify_play_cmd_show(struct device *dev,
-				     struct device_attribute *attr, char *buf)
+static ssize_t playlist_budget_show(struct player *player, char *buf)
 {
-	struct priv *priv;
-	priv = (struct priv *)dev_get_drvdata(dev);
+	return sprintf(buf, "%zu\n", READ_ONCE(player->playlist->budget));
+}
 
-	return sprintf(buf, "%d\n", get_player_state(priv->player));
+static ssize_t playlist_budget_store(struct player *player, const char *buf,
+				     size_t count)
+{
+	unsigned long budget;
+
+	if (kstrtoul(buf, 10, &budget) != 0 || budget == 0) {
+		pr_err("[%s]: Invalid budget\n", LIB_NAME);
+		return -EINVAL;
+	}
+
+	set_playlist_budget(player->playlist, budget);
+	return count;
 }
 
-static ssize_t drivify_play_cmd_store(struct device *dev,
-				      struct device_attribute *attr,
-				      const char *buf, size_t count)
+static ssize_t playlist_memory_show(struct player *player, char *buf)
 {
-	struct priv *priv;
-	priv = (struct priv *)dev_get_drvdata(dev);
+	return sprintf(buf, "%zu\n", get_playlist_memory(player->playlist));
+}
+
+static ssize_t playlist_mode_show(struct player *player, char *buf)
+{
+	enum playlist_mode mode;
+	ssize_t len = 0;
+
+	/// the current mode is shown between brackets among the others
+	mode = READ_ONCE(player->playlist->mode);
+	for (int i = 0; i < NB_PLAYLIST_MODES; i++) {
+		len += sysfs_emit_at(buf, len, i == mode ? "[%s] " : "%s ",
+				     playlist_mode_name(i));
+	}
+	buf[len - 1] = '\n';
+	return len;
+}
+
+static ssize_t playlist_mode_store(struct player *player, const char *buf,
+				   size_t count)
+{
+	int mode;
+
+	mode = parse_playlist_mode(buf);
+	if (mode < 0) {
+		pr_err("[%s]: Invalid playlist mode\n", LIB_NAME);
+		return -EINVAL;
+	}
+
+	set_playlist_mode(player->playlist, mode, &player->queue_lock);
+	return count;
+}
 
-	pr_info("[%s]: cmd received: %s\n", LIB_NAME, buf);
+static ssize_t commands_stats_show(struct player *player, char *buf)
+{
+	struct command_stats stats;
+
+	get_command_stats(player, &stats);
+
+	return sprintf(buf, "enqueued %u\napplied %u\ndropped %u\n",
+		       stats.enqueued, stats.applied, stats.dropped);
+}
+
+static ssize_t play_cmd_show(struct player *player, char *buf)
+{
+	return sprintf(buf, "%d\n", get_player_state(player));
+}
+
+static ssize_t play_cmd_store(struct player *player, const char *buf,
+			      size_t count)
+{
+	pr_debug("[%s]: cmd received: %s\n", LIB_NAME, buf);
 
 	if (strncmp(buf, "0", 1) == 0) {
-		pr_info("[%s]: cmd Pause sent to player\n", LIB_NAME);
-		do_pause(priv->player);
+		pr_debug("[%s]: cmd Pause sent to player\n", LIB_NAME);
+		do_pause(player);
 	} else if (strncmp(buf, "1", 1) == 0) {
-		pr_info("[%s]: cmd Play sent to player\n", LIB_NAME);
-		do_play(priv->player);
+		pr_debug("[%s]: cmd Play sent to player\n", LIB_NAME);
+		do_play(player);
 	} else {
 		pr_err("[%s]: Invalid command\n", LIB_NAME);
 		return -EINVAL;
@@ -112,33 +179,26 @@ static ssize_t drivify_play_cmd_store(struct device *dev,
 	return count;
 }
 
-static ssize_t drivify_time_cmd_show(struct device *dev,
-				     struct device_attribute *attr, char *buf)
+static ssize_t time_cmd_show(struct player *player, char *buf)
 {
-	struct priv *priv;
 	uint32_t current_duration;
 
-	priv = (struct priv *)dev_get_drvdata(dev);
-
-	get_current_duration(priv->player, &current_duration);
+	get_current_duration(player, &current_duration);
 
 	return sprintf(buf, "%d\n", current_duration);
 }
 
-static ssize_t drivify_time_cmd_store(struct device *dev,
-				      struct device_attribute *attr,
-				      const char *buf, size_t count)
+static ssize_t time_cmd_store(struct player *player, const char *buf,
+			      size_t count)
 {
-	struct priv *priv;
 	uint32_t time;
-	priv = (struct priv *)dev_get_drvdata(dev);
 
 	if (kstrtou32(buf, 10, &time) != 0) {
 		pr_err("[%s]: Invalid time\n", LIB_NAME);
 		return -EINVAL;
 	}
 
-	if (set_current_duration(priv->player, time) != 0) {
+	if (set_current_duration(player, time) != 0) {
 		pr_err("[%s]: Invalid time\n", LIB_NAME);
 		return -EINVAL;
 	}
@@ -146,34 +206,268 @@ static ssize_t drivify_time_cmd_store(struct device *dev,
 	return count;
 }
 
-static DEVICE_ATTR_RO(drivify_current_title);
-static DEVICE_ATTR_RO(drivify_current_artist);
-static DEVICE_ATTR_RO(drivify_current_duration);
-static DEVICE_ATTR_RO(drivify_playlist_total_songs);
-static DEVICE_ATTR_RO(drivify_playlist_total_duration);
-static DEVICE_ATTR_RW(drivify_play_cmd);
-static DEVICE_ATTR_RW(drivify_time_cmd);
+static ssize_t outputs_show(struct player *player, char *buf)
+{
+	unsigned int outputs;
+	ssize_t len = 0;
+
+	outputs = atomic_read(&player->outputs);
+	for (int i = 0; i < ARRAY_SIZE(OUTPUT_NAMES); i++) {
+		if (outputs & BIT(i)) {
+			len += sysfs_emit_at(buf, len, "%s ", OUTPUT_NAMES[i]);
+		}
+	}
+	if (len == 0) {
+		return sprintf(buf, "none\n");
+	}
+	buf[len - 1] = '\n';
+	return len;
+}
+
+static ssize_t outputs_store(struct player *player, const char *buf,
+			     size_t count)
+{
+	unsigned int outputs = 0;
+	char *names;
+	char *cursor;
+	char *name;
+	int index;
+
+	/// the outputs are given by name, separated by spaces, "none" for none
+	names = kstrdup(buf, GFP_KERNEL);
+	if (!names) {
+		return -ENOMEM;
+	}
+	cursor = strim(names);
+	while ((name = strsep(&cursor, " ")) != NULL) {
+		if (*name == '\0' || strcmp(name, "none") == 0) {
+			continue;
+		}
+		index = match_string(OUTPUT_NAMES, ARRAY_SIZE(OUTPUT_NAMES),
+				     name);
+		if (index < 0) {
+			pr_err("[%s]: Invalid output %s\n", LIB_NAME, name);
+			kfree(names);
+			return -EINVAL;
+		}
+		outputs |= BIT(index);
+	}
+	kfree(names);
+
+	set_player_outputs(player, outputs);
+	return count;
+}
+
+#define PLAYER_ATTR_RO(_name)                                            \
+	static struct player_attribute player_attr_##_name = __ATTR_RO(_name)
+#define PLAYER_ATTR_RW(_name)                                            \
+	static struct player_attribute player_attr_##_name = __ATTR_RW(_name)
+
+PLAYER_ATTR_RO(current_title);
+PLAYER_ATTR_RO(current_artist);
+PLAYER_ATTR_RO(current_duration);
+PLAYER_ATTR_RO(playlist_total_songs);
+PLAYER_ATTR_RO(playlist_total_duration);
+PLAYER_ATTR_RW(playlist_budget);
+PLAYER_ATTR_RO(playlist_memory);
+PLAYER_ATTR_RW(playlist_mode);
+PLAYER_ATTR_RO(commands_stats);
+PLAYER_ATTR_RW(play_cmd);
+PLAYER_ATTR_RW(time_cmd);
+PLAYER_ATTR_RW(outputs);
+
+static struct attribute *player_attrs[] = {
+	&player_attr_current_title.attr,
+	&player_attr_current_artist.attr,
+	&player_attr_current_duration.attr,
+	&player_attr_playlist_total_songs.attr,
+	&player_attr_playlist_total_duration.attr,
+	&player_attr_playlist_budget.attr,
+	&player_attr_playlist_memory.attr,
+	&player_attr_playlist_mode.attr,
+	&player_attr_commands_stats.attr,
+	&player_attr_play_cmd.attr,
+	&player_attr_time_cmd.attr,
+	&player_attr_outputs.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(player);
+
+static ssize_t player_attr_show(struct kobject *kobj, struct attribute *attr,
+				char *buf)
+{
+	struct player_attribute *player_attr;
+	struct player_kobj *pkobj;
+
+	player_attr = container_of(attr, struct player_attribute, attr);
+	pkobj = container_of(kobj, struct player_kobj, kobj);
+	if (!player_attr->show) {
+		return -EIO;
+	}
+	return player_attr->show(pkobj->player, buf);
+}
+
+static ssize_t player_attr_store(struct kobject *kobj, struct attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct player_attribute *player_attr;
+	struct player_kobj *pkobj;
+
+	player_attr = container_of(attr, struct player_attribute, attr);
+	pkobj = container_of(kobj, struct player_kobj, kobj);
+	if (!player_attr->store) {
+		return -EIO;
+	}
+	return player_attr->store(pkobj->player, buf, count);
+}
+
+static void player_kobj_release(struct kobject *kobj)
+{
+	kfree(container_of(kobj, struct player_kobj, kobj));
+}
+
+static const struct sysfs_ops player_sysfs_ops = {
+	.show = player_attr_show,
+	.store = player_attr_store,
+};
+
+static struct kobj_type player_ktype = {
+	.release = player_kobj_release,
+	.sysfs_ops = &player_sysfs_ops,
+	.default_groups = player_groups,
+};
+
+/// the attributes of the device are kept for the first player, they have
+/// the drivify_ prefix
+#define DEFAULT_PLAYER_SHOW(_name)                                         \
+	static ssize_t drivify_##_name##_show(struct device *dev,          \
+					      struct device_attribute *attr, \
+					      char *buf)                     \
+	{                                                                  \
+		struct priv *priv = dev_get_drvdata(dev);                  \
+		return _name##_show(get_player(priv, 0), buf);             \
+	}
+
+#define DEFAULT_PLAYER_STORE(_name)                                        \
+	static ssize_t drivify_##_name##_store(struct device *dev,         \
+					       struct device_attribute *attr, \
+					       const char *buf, size_t count) \
+	{                                                                  \
+		struct priv *priv = dev_get_drvdata(dev);                  \
+		return _name##_store(get_player(priv, 0), buf, count);     \
+	}
+
+#define DEFAULT_PLAYER_ATTR_RO(_name)                                      \
+	DEFAULT_PLAYER_SHOW(_name)                                         \
+	static DEVICE_ATTR_RO(drivify_##_name)
+
+#define DEFAULT_PLAYER_ATTR_RW(_name)                                      \
+	DEFAULT_PLAYER_SHOW(_name)                                         \
+	DEFAULT_PLAYER_STORE(_name)                                        \
+	static DEVICE_ATTR_RW(drivify_##_name)
+
+DEFAULT_PLAYER_ATTR_RO(current_title);
+DEFAULT_PLAYER_ATTR_RO(current_artist);
+DEFAULT_PLAYER_ATTR_RO(current_duration);
+DEFAULT_PLAYER_ATTR_RO(playlist_total_songs);
+DEFAULT_PLAYER_ATTR_RO(playlist_total_duration);
+DEFAULT_PLAYER_ATTR_RW(playlist_budget);
+DEFAULT_PLAYER_ATTR_RO(playlist_memory);
+DEFAULT_PLAYER_ATTR_RW(playlist_mode);
+DEFAULT_PLAYER_ATTR_RO(commands_stats);
+DEFAULT_PLAYER_ATTR_RW(play_cmd);
+DEFAULT_PLAYER_ATTR_RW(time_cmd);
+
+static ssize_t drivify_nb_players_show(struct device *dev,
+				       struct device_attribute *attr, char *buf)
+{
+	struct priv *priv;
+	priv = (struct priv *)dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", get_nb_players(priv));
+}
+
+static ssize_t drivify_add_player_store(struct device *dev,
+					struct device_attribute *attr,
+					const char *buf, size_t count)
+{
+	struct priv *priv;
+	int id;
+	priv = (struct priv *)dev_get_drvdata(dev);
+
+	id = add_player(priv);
+	if (id < 0) {
+		return id;
+	}
+	return count;
+}
+
+static DEVICE_ATTR_RO(drivify_nb_players);
+static DEVICE_ATTR_WO(drivify_add_player);
+
+static struct device_attribute *drivify_attrs[] = {
+	&dev_attr_drivify_current_title,
+	&dev_attr_drivify_current_artist,
+	&dev_attr_drivify_current_duration,
+	&dev_attr_drivify_playlist_total_songs,
+	&dev_attr_drivify_playlist_total_duration,
+	&dev_attr_drivify_playlist_budget,
+	&dev_attr_drivify_playlist_memory,
+	&dev_attr_drivify_playlist_mode,
+	&dev_attr_drivify_commands_stats,
+	&dev_attr_drivify_play_cmd,
+	&dev_attr_drivify_time_cmd,
+	&dev_attr_drivify_nb_players,
+	&dev_attr_drivify_add_player,
+};
 
 void init_drivify_sysfs(struct device *dev)
 {
 	pr_info("[%s]: init sysfs \n", LIB_NAME);
-	device_create_file(dev, &dev_attr_drivify_current_title);
-	device_create_file(dev, &dev_attr_drivify_current_artist);
-	device_create_file(dev, &dev_attr_drivify_current_duration);
-	device_create_file(dev, &dev_attr_drivify_playlist_total_songs);
-	device_create_file(dev, &dev_attr_drivify_playlist_total_duration);
-	device_create_file(dev, &dev_attr_drivify_play_cmd);
-	device_create_file(dev, &dev_attr_drivify_time_cmd);
+	for (int i = 0; i < ARRAY_SIZE(drivify_attrs); i++) {
+		device_create_file(dev, drivify_attrs[i]);
+	}
 }
 
 void remove_drivify_sysfs(struct device *dev)
 {
 	pr_info("[%s]: remove sysfs\n", LIB_NAME);
-	device_remove_file(dev, &dev_attr_drivify_current_title);
-	device_remove_file(dev, &dev_attr_drivify_current_artist);
-	device_remove_file(dev, &dev_attr_drivify_current_duration);
-	device_remove_file(dev, &dev_attr_drivify_playlist_total_songs);
-	device_remove_file(dev, &dev_attr_drivify_playlist_total_duration);
-	device_remove_file(dev, &dev_attr_drivify_play_cmd);
-	device_remove_file(dev, &dev_attr_drivify_time_cmd);
+	for (int i = 0; i < ARRAY_SIZE(drivify_attrs); i++) {
+		device_remove_file(dev, drivify_attrs[i]);
+	}
+}
+
+int init_player_sysfs(struct player *player, struct kobject *parent)
+{
+	struct player_kobj *pkobj;
+	int err;
+
+	pkobj = kzalloc(sizeof(struct player_kobj), GFP_KERNEL);
+	if (!pkobj) {
+		return -ENOMEM;
+	}
+	pkobj->player = player;
+
+	err = kobject_init_and_add(&pkobj->kobj, &player_ktype, parent,
+				   "player%u", player->id);
+	if (err) {
+		pr_err("[%s]: Failed to create the directory of player %u\n",
+		       LIB_NAME, player->id);
+		// the release frees the directory
+		kobject_put(&pkobj->kobj);
+		return err;
+	}
+
+	player->kobj = &pkobj->kobj;
+	return 0;
+}
+
+void remove_player_sysfs(struct player *player)
+{
+	if (!player->kobj) {
+		return;
+	}
+	kobject_del(player->kobj);
+	kobject_put(player->kobj);
+	player->kobj = NULL;
 }
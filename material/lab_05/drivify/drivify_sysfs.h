@@ -2,13 +2,26 @@
 #define DRIVIFY_SYSFS_H
 
 #include <linux/device.h>
+#include "drivify_shared_types.h"
 
 /// @brief Initialize the drivify sysfs
 /// @param dev The device to add the sysfs to
+/// @note the attributes of the device control the first player
 void init_drivify_sysfs(struct device *dev);
 
 /// @brief Remove the drivify sysfs
 /// @param dev The device to remove the sysfs from
 void remove_drivify_sysfs(struct device *dev);
 
+/// @brief Create the sysfs directory of a player
+/// @param player The player
+/// @param parent The directory of the device
+/// @return 0 if no error
+int init_player_sysfs(struct player *player, struct kobject *parent);
+
+/// @brief Remove the sysfs directory of a player
+/// @param player The player
+/// @note this method waits for the attributes in use
+void remove_player_sysfs(struct player *player);
+
 #endif // DRIVIFY_SYSFS_H
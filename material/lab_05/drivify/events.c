@@ -0,0 +1,67 @@
+#include "events.h"
+#include <linux/kernel.h>
+#include <linux/string.h>
+
+void init_event_log(struct event_log *log)
+{
+	memset(log->ring, 0, sizeof(log->ring));
+	log->head = 0;
+	spin_lock_init(&log->lock);
+	init_waitqueue_head(&log->wait_queue);
+}
+
+void publish_event(struct event_log *log, struct drivify_event *event)
+{
+	unsigned long irq_flags;
+
+	spin_lock_irqsave(&log->lock, irq_flags);
+	event->seq = log->head;
+	log->ring[log->head & (EVENT_LOG_SIZE - 1)] = *event;
+	log->head++;
+	spin_unlock_irqrestore(&log->lock, irq_flags);
+
+	wake_up_interruptible(&log->wait_queue);
+}
+
+uint32_t get_first_cursor(struct event_log *log)
+{
+	uint32_t head;
+
+	head = READ_ONCE(log->head);
+	return head == 0 ? 0 : head - 1;
+}
+
+bool has_events(struct event_log *log, uint32_t cursor)
+{
+	return READ_ONCE(log->head) != cursor;
+}
+
+int read_events(struct event_log *log, uint32_t *cursor,
+		struct drivify_event *events, int max_events)
+{
+	unsigned long irq_flags;
+	uint32_t pos;
+	bool lost = false;
+	int nb_events = 0;
+
+	spin_lock_irqsave(&log->lock, irq_flags);
+	pos = *cursor;
+	// the sequence numbers wrap, then the distance is computed unsigned
+	if (log->head - pos > EVENT_LOG_SIZE) {
+		pos = log->head - EVENT_LOG_SIZE;
+		lost = true;
+	}
+
+	while (pos != log->head && nb_events < max_events) {
+		events[nb_events] = log->ring[pos & (EVENT_LOG_SIZE - 1)];
+		nb_events++;
+		pos++;
+	}
+	*cursor = pos;
+	spin_unlock_irqrestore(&log->lock, irq_flags);
+
+	if (lost && nb_events > 0) {
+		events[0].flags |= EVENT_LOST;
+	}
+	return nb_events;
+}
@@ -0,0 +1,51 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include "drivify_event.h"
+
+#define EVENT_LOG_SIZE 32 // must be a power of 2
+
+///@brief ring of the last events published by a player
+struct event_log {
+	struct drivify_event ring[EVENT_LOG_SIZE];
+	uint32_t head; // sequence number of the next event to publish
+	spinlock_t lock;
+	wait_queue_head_t wait_queue;
+};
+
+/// @brief Initialize an event log
+/// @param log the log to initialize
+void init_event_log(struct event_log *log);
+
+/// @brief Publish an event and wake up the readers
+/// @param log the log to publish to
+/// @param event the event to publish, its sequence number is set by the log
+/// @note in this method a spinlock is used to protect the ring, the irq will be saved and restored
+void publish_event(struct event_log *log, struct drivify_event *event);
+
+/// @brief Get the cursor a new reader has to start from
+/// @param log the log
+/// @return the sequence number of the last published event so that a new
+/// reader receives the current state immediately
+uint32_t get_first_cursor(struct event_log *log);
+
+/// @brief Check if events are available for a reader
+/// @param log the log
+/// @param cursor the cursor of the reader
+/// @return true if at least one event can be read
+bool has_events(struct event_log *log, uint32_t cursor);
+
+/// @brief Copy the events following a cursor
+/// @param log the log
+/// @param cursor the cursor of the reader, updated after the copy
+/// @param events the buffer to fill
+/// @param max_events the maximum number of events to copy
+/// @return the number of events copied
+/// @note if the reader was overtaken, the first copied event is flagged with EVENT_LOST
+/// @note in this method a spinlock is used to protect the ring, the irq will be saved and restored
+int read_events(struct event_log *log, uint32_t *cursor,
+		struct drivify_event *events, int max_events);
+
+#endif // EVENTS_H
@@ -249,18 +249,18 @@ void display_number_on_displays(int value, int radix,
 	}
 }
 
-void display_time_3_0(int secondes, volatile void *__iomem reg)
+uint32_t encode_time_3_0(int secondes)
 {
 	int minutes;
 	if (secondes < 0) {
 		pr_err("[%s]: The time must be positive\n", LIB_NAME);
-		return;
+		return 0;
 	}
 
-	minutes = secondes / 60;
+	minutes = (secondes / 60) % 100;
 	secondes %= 60;
-	display_digit_0_3(secondes % 10, 0, reg);
-	display_digit_0_3(secondes / 10, 1, reg);
-	display_digit_0_3(minutes % 10, 2, reg);
-	display_digit_0_3(minutes / 10, 3, reg);
+	return DIGITS[secondes % 10] |
+	       DIGITS[secondes / 10] << HEX_DISPLAY_OFFSET |
+	       DIGITS[minutes % 10] << (2 * HEX_DISPLAY_OFFSET) |
+	       DIGITS[minutes / 10] << (3 * HEX_DISPLAY_OFFSET);
 }
@@ -83,8 +83,9 @@ void display_number_on_displays(int value, int radix,
 				volatile void *__iomem reg_0_3,
 				volatile void *__iomem reg_4_5);
 
-/// @brief Method to display a time on the hex displays
+/// @brief Method to compute the value of the register of the first 4 hex
+/// displays showing a time
 /// @param secondes The time in secondes
-/// @param reg The register of the display
-void display_time_3_0(int secondes, volatile void *__iomem reg);
+/// @return the value of the register, the displays show MM:SS
+uint32_t encode_time_3_0(int secondes);
 #endif // HEX_H
@@ -11,8 +11,11 @@
 
 int main(int argc, char *argv[])
 {
+	uint8_t record[MUSIC_RECORD_MAX_SIZE];
 	struct music music;
-	char *ret_ptr;
+	size_t name_len;
+	size_t artist_len;
+	int duration;
 	int fd;
 	int nb_written;
 
@@ -22,44 +25,59 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
-	ret_ptr = strncpy(music.name, argv[1], NAME_SIZE);
-
-	if (strlen(ret_ptr) == 0) {
+	name_len = strnlen(argv[1], NAME_SIZE);
+	if (name_len == 0) {
 		perror("The music name cannot be empty.\n");
 		return EXIT_FAILURE;
 	}
+	if (name_len >= NAME_SIZE) {
+		perror("The music name is too long.\n");
+		return EXIT_FAILURE;
+	}
 
-	ret_ptr = strncpy(music.artist, argv[2], ARTIST_SIZE);
-	if (strlen(ret_ptr) == 0) {
+	artist_len = strnlen(argv[2], ARTIST_SIZE);
+	if (artist_len == 0) {
 		perror("The artist name cannot be empty.\n");
 		return EXIT_FAILURE;
 	}
+	if (artist_len >= ARTIST_SIZE) {
+		perror("The artist name is too long.\n");
+		return EXIT_FAILURE;
+	}
 
-	music.duration = atoi(argv[3]);
-	if (music.duration <= 0) {
+	duration = atoi(argv[3]);
+	if (duration <= 0) {
 		perror("Duration must be greater than 0.\n");
 		return EXIT_FAILURE;
 	}
 
+	// the record is followed by the strings without null terminator
+	music.duration = duration;
+	music.name_len = name_len;
+	music.artist_len = artist_len;
+	memcpy(record, &music, sizeof(music));
+	memcpy(record + sizeof(music), argv[1], name_len);
+	memcpy(record + sizeof(music) + name_len, argv[2], artist_len);
+
 	fd = open(DEVICE_NAME, O_WRONLY);
 	if (fd < 0) {
 		perror("Failed to open device");
 		return EXIT_FAILURE;
 	}
-	nb_written = write(fd, &music, sizeof(music));
+	nb_written = write(fd, record, music_record_size(&music));
 	if (nb_written < 0) {
 		perror("Failed to write to write on device, please check dmesg");
 		close(fd);
 		return EXIT_FAILURE;
 
-	} else if (nb_written != sizeof(music)) {
-		perror("Failed to write the whole music structure, please check dmesg");
+	} else if (nb_written != (int)music_record_size(&music)) {
+		perror("Failed to write the whole music record, please check dmesg");
 		close(fd);
 		return EXIT_FAILURE;
 	}
 
 	printf("Song added: [Title]: '%s' [Artiste]: '%s', [Duration]: %d seconds.\n",
-	       music.name, music.artist, music.duration);
+	       argv[1], argv[2], duration);
 
 	close(fd);
 	return 0;
@@ -28,7 +28,8 @@ uint8_t read_keys(void __iomem *key_reg)
 
 	edge_capture_reg = key_reg + KEYS_EDGE_OFFSET;
 	keys = ioread8(edge_capture_reg);
-	printk(KERN_INFO "[%s]: Reading keys: 0x%x\n", HW_NAME, keys);
+	// this method is called in hard irq context, nothing is logged by default
+	pr_debug("[%s]: Reading keys: 0x%x\n", HW_NAME, keys);
 	return keys;
 }
 
@@ -84,3 +85,53 @@ uint8_t key_status_interrupts(void __iomem *key_reg, uint8_t key_mask)
 	key_status = ioread8(edge_capture_mask_reg) & key_mask;
 	return key_status;
 }
+
+void keys_input_init(struct keys_input *input)
+{
+	INIT_KFIFO(input->queue);
+	for (int i = 0; i < NUM_KEYS; i++) {
+		input->last_press[i] = 0;
+	}
+	atomic_set(&input->nb_dropped, 0);
+}
+
+bool keys_queue_press(struct keys_input *input, uint8_t mask)
+{
+	struct key_press press;
+
+	press.mask = mask;
+	press.timestamp = ktime_get();
+	if (!kfifo_put(&input->queue, press)) {
+		atomic_inc(&input->nb_dropped);
+		return false;
+	}
+	return true;
+}
+
+bool keys_next_press(struct keys_input *input, uint8_t *mask)
+{
+	struct key_press press;
+	ktime_t debounce;
+
+	if (!kfifo_get(&input->queue, &press)) {
+		return false;
+	}
+
+	/// a key is ignored if it was already pressed during the debounce
+	/// delay, it does not depend on the hardware that produced the edges
+	debounce = ms_to_ktime(KEYS_DEBOUNCE_MS);
+	*mask = 0;
+	for (int i = 0; i < NUM_KEYS; i++) {
+		if (!(press.mask & (1 << i))) {
+			continue;
+		}
+		if (input->last_press[i] != 0 &&
+		    ktime_before(press.timestamp,
+				 ktime_add(input->last_press[i], debounce))) {
+			continue;
+		}
+		input->last_press[i] = press.timestamp;
+		*mask |= 1 << i;
+	}
+	return true;
+}
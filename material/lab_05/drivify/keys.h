@@ -3,14 +3,35 @@
 
 #include <linux/types.h>
 #include <linux/module.h>
+#include <linux/kfifo.h>
+#include <linux/ktime.h>
 
 #define KEYS_OFFSET 0x50
 #define KEYS_MASK 0x0F
 #define KEYS_IRQ_OFFSET 0x8
 #define KEYS_EDGE_OFFSET 0xC
 
+#define NUM_KEYS 4
+#define KEYS_QUEUE_SIZE 32 // must be a power of 2
+#define KEYS_DEBOUNCE_MS 20
+
 #define HW_NAME "keys"
 
+///@brief a snapshot of the edge capture register
+struct key_press {
+	uint8_t mask;
+	ktime_t timestamp;
+};
+
+///@brief queue of the key presses between the irq and its thread
+///@note the queue has a single producer (the irq) and a single consumer
+/// (the irq thread) then the kfifo does not need any lock
+struct keys_input {
+	DECLARE_KFIFO(queue, struct key_press, KEYS_QUEUE_SIZE);
+	ktime_t last_press[NUM_KEYS]; // only used by the consumer
+	atomic_t nb_dropped;
+};
+
 /// @brief Method to read the key
 /// @param key_reg the register of the key
 /// @param key_index
@@ -40,6 +61,23 @@ void keys_clear_edge_reg(void __iomem *key_reg, uint8_t key_mask);
 /// @param key_mask the mask of the key to clear the interrupt
 // void keys_clear_interrupt(void __iomem *key_reg, uint8_t key_mask);
 
+/// @brief Initialize the queue of key presses
+/// @param input the queue to initialize
+void keys_input_init(struct keys_input *input);
+
+/// @brief Queue a key press, this method is meant to be called from the irq
+/// @param input the queue
+/// @param mask the mask of the keys captured by the edge register
+/// @return true if the press is queued, false if the queue is full
+bool keys_queue_press(struct keys_input *input, uint8_t mask);
+
+/// @brief Get the next debounced key press
+/// @param input the queue
+/// @param mask the mask of the keys pressed, bounces are removed
+/// @return true if a press was dequeued, false if the queue is empty
+/// @note a press may be dequeued with an empty mask when all its keys bounced
+bool keys_next_press(struct keys_input *input, uint8_t *mask);
+
 /// @brief Method to read the status of the key interrupts
 /// @param key_reg the register of the key
 /// @param key_mask
@@ -0,0 +1,161 @@
+#include "lock_stats.h"
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/module.h>
+#include <linux/sched/clock.h>
+#include <linux/seq_file.h>
+
+#define LOCK_STATS_DIR "drivify"
+
+///@brief every site that has taken a lock at least once, never emptied
+static LLIST_HEAD(lock_sites);
+static struct dentry *lock_stats_dir;
+
+/// @brief Keep the biggest value
+/// @param max the maximum to update
+/// @param value the new value
+static void update_max(atomic64_t *max, s64 value);
+
+/// @brief Show one line per site
+/// @param s the seq file
+/// @param unused unused
+/// @return 0
+static int lock_stats_show(struct seq_file *s, void *unused);
+
+/// @brief Open the debugfs file as a single seq file
+/// @param inode the inode of the file
+/// @param filp the file
+/// @return 0 if no error
+static int lock_stats_open(struct inode *inode, struct file *filp);
+
+/// @brief Reset the statistics of every site
+/// @param filp the debugfs file
+/// @param buf ignored
+/// @param count the size of the buffer
+/// @param ppos ignored
+/// @return count
+static ssize_t lock_stats_write(struct file *filp, const char __user *buf,
+				size_t count, loff_t *ppos);
+
+static void update_max(atomic64_t *max, s64 value)
+{
+	s64 old;
+	s64 prev;
+
+	old = atomic64_read(max);
+	while (value > old) {
+		prev = atomic64_cmpxchg(max, old, value);
+		if (prev == old) {
+			break;
+		}
+		old = prev;
+	}
+}
+
+void init_stat_spinlock(struct stat_spinlock *slock)
+{
+	spin_lock_init(&slock->lock);
+	slock->locked_at = 0;
+	slock->site = NULL;
+}
+
+unsigned long __stat_spin_lock_irqsave(struct stat_spinlock *slock,
+				       struct lock_site *site)
+{
+	unsigned long flags;
+	u64 start;
+	u64 wait;
+
+	if (!atomic_read(&site->registered) &&
+	    !atomic_xchg(&site->registered, 1)) {
+		llist_add(&site->node, &lock_sites);
+	}
+
+	start = local_clock();
+	spin_lock_irqsave(&slock->lock, flags);
+	slock->locked_at = local_clock();
+	slock->site = site;
+
+	wait = slock->locked_at - start;
+	atomic64_inc(&site->nb_acquired);
+	atomic64_add(wait, &site->wait_ns);
+	update_max(&site->wait_max_ns, wait);
+	return flags;
+}
+
+void stat_spin_unlock_irqrestore(struct stat_spinlock *slock,
+				 unsigned long flags)
+{
+	struct lock_site *site;
+	u64 hold;
+
+	site = slock->site;
+	hold = local_clock() - slock->locked_at;
+	spin_unlock_irqrestore(&slock->lock, flags);
+
+	atomic64_add(hold, &site->hold_ns);
+	update_max(&site->hold_max_ns, hold);
+}
+
+static int lock_stats_show(struct seq_file *s, void *unused)
+{
+	struct llist_node *first;
+	struct lock_site *site;
+	s64 nb;
+
+	first = smp_load_acquire(&lock_sites.first);
+	llist_for_each_entry(site, first, node) {
+		nb = atomic64_read(&site->nb_acquired);
+		seq_printf(s,
+			   "%s:%d acquired %lld wait_avg_ns %lld wait_max_ns %lld hold_avg_ns %lld hold_max_ns %lld\n",
+			   site->func, site->line, nb,
+			   nb ? atomic64_read(&site->wait_ns) / nb : 0,
+			   atomic64_read(&site->wait_max_ns),
+			   nb ? atomic64_read(&site->hold_ns) / nb : 0,
+			   atomic64_read(&site->hold_max_ns));
+	}
+	return 0;
+}
+
+static int lock_stats_open(struct inode *inode, struct file *filp)
+{
+	return single_open(filp, lock_stats_show, NULL);
+}
+
+static ssize_t lock_stats_write(struct file *filp, const char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	struct llist_node *first;
+	struct lock_site *site;
+
+	first = smp_load_acquire(&lock_sites.first);
+	llist_for_each_entry(site, first, node) {
+		atomic64_set(&site->nb_acquired, 0);
+		atomic64_set(&site->wait_ns, 0);
+		atomic64_set(&site->wait_max_ns, 0);
+		atomic64_set(&site->hold_ns, 0);
+		atomic64_set(&site->hold_max_ns, 0);
+	}
+	return count;
+}
+
+static const struct file_operations lock_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = lock_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.write = lock_stats_write,
+};
+
+void init_lock_stats_debugfs(void)
+{
+	lock_stats_dir = debugfs_create_dir(LOCK_STATS_DIR, NULL);
+	debugfs_create_file("locks", 0644, lock_stats_dir, NULL,
+			    &lock_stats_fops);
+}
+
+void remove_lock_stats_debugfs(void)
+{
+	debugfs_remove_recursive(lock_stats_dir);
+}
@@ -0,0 +1,65 @@
+#ifndef LOCK_STATS_H
+#define LOCK_STATS_H
+
+#include <linux/atomic.h>
+#include <linux/llist.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+///@brief the statistics of one place of the code taking a lock
+///@note a site is static and registers itself the first time it takes a
+/// lock, the same site of every player shares the same statistics
+struct lock_site {
+	const char *func;
+	int line;
+	atomic_t registered;
+	struct llist_node node;
+	atomic64_t nb_acquired;
+	atomic64_t wait_ns; // total time spent waiting for the lock
+	atomic64_t wait_max_ns;
+	atomic64_t hold_ns; // total time the lock was held, irqs disabled
+	atomic64_t hold_max_ns;
+};
+
+///@brief a spinlock that measures its waiting and holding times
+struct stat_spinlock {
+	spinlock_t lock;
+	u64 locked_at; // only used by the holder
+	struct lock_site *site; // site of the holder
+};
+
+/// @brief Initialize a measured spinlock
+/// @param slock the lock to initialize
+void init_stat_spinlock(struct stat_spinlock *slock);
+
+/// @brief Take the lock and disable the irqs, use stat_spin_lock_irqsave
+/// @param slock the lock
+/// @param site the statistics of the caller
+/// @return the irq flags to restore
+unsigned long __stat_spin_lock_irqsave(struct stat_spinlock *slock,
+				       struct lock_site *site);
+
+/// @brief Release the lock, the holding time is given to the site that took it
+/// @param slock the lock
+/// @param flags the irq flags returned when the lock was taken
+void stat_spin_unlock_irqrestore(struct stat_spinlock *slock,
+				 unsigned long flags);
+
+/// @brief spin_lock_irqsave on a measured lock, each call is its own site
+#define stat_spin_lock_irqsave(slock, flags)                            \
+	do {                                                            \
+		static struct lock_site __lock_site = {                 \
+			.func = __func__,                               \
+			.line = __LINE__,                               \
+		};                                                      \
+		flags = __stat_spin_lock_irqsave(slock, &__lock_site); \
+	} while (0)
+
+/// @brief Create the debugfs file showing the statistics of every site
+/// @note writing anything in the file resets the statistics
+void init_lock_stats_debugfs(void);
+
+/// @brief Remove the debugfs file
+void remove_lock_stats_debugfs(void);
+
+#endif // LOCK_STATS_H
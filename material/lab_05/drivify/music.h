@@ -1,13 +1,32 @@
 #ifndef MUSIC_H
 #define MUSIC_H
 
-#define NAME_SIZE 25
-#define ARTIST_SIZE 25
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#endif
 
+#define NAME_SIZE 256 // including the null terminator
+#define ARTIST_SIZE 256 // including the null terminator
+#define MUSIC_RECORD_MAX_SIZE (sizeof(struct music) + NAME_SIZE + ARTIST_SIZE)
+
+/// @brief Record of a song written on /dev/drivify
+/// @note the record is followed by name_len bytes of the title and artist_len
+/// bytes of the artist, both without null terminator
 struct music {
-	char name[NAME_SIZE];
-	char artist[ARTIST_SIZE];
-	unsigned int duration;
-};
+	uint32_t duration;
+	uint8_t name_len;
+	uint8_t artist_len;
+} __attribute__((packed));
+
+/// @brief Get the size of a record and its strings
+/// @param music the record
+/// @return the size of the record
+static inline size_t music_record_size(const struct music *music)
+{
+	return sizeof(struct music) + music->name_len + music->artist_len;
+}
 
 #endif // MUSIC_H
@@ -0,0 +1,67 @@
+#include "drivify_event.h"
+#include "drivify_ioctl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#define DEVICE_NAME "/dev/drivify"
+#define NB_EVENTS 16
+
+int main(int argc, char *argv[])
+{
+	struct drivify_event events[NB_EVENTS];
+	ssize_t nb_read;
+	uint32_t player;
+	int fd;
+
+	if (argc > 2) {
+		fprintf(stderr, "Usage: %s [player]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	fd = open(DEVICE_NAME, O_RDONLY);
+	if (fd < 0) {
+		perror("Failed to open device");
+		return EXIT_FAILURE;
+	}
+
+	// the first player is followed by default
+	if (argc == 2) {
+		player = strtoul(argv[1], NULL, 10);
+		if (ioctl(fd, DRIVIFY_IOC_SELECT_PLAYER, &player) < 0) {
+			perror("Failed to select the player");
+			close(fd);
+			return EXIT_FAILURE;
+		}
+	}
+
+	// each read blocks until the player changes
+	while ((nb_read = read(fd, events, sizeof(events))) > 0) {
+		for (int i = 0; i < nb_read / (ssize_t)sizeof(events[0]); i++) {
+			struct drivify_event *event = &events[i];
+
+			if (event->flags & EVENT_LOST) {
+				printf("Some events were lost\n");
+			}
+			if (event->flags & EVENT_TRACK) {
+				printf("New track of %u seconds\n",
+				       event->duration);
+			}
+			printf("[%u] %s %02u:%02u, %u song(s)\n", event->seq,
+			       event->state ? "Playing" : "Paused",
+			       event->position / 60, event->position % 60,
+			       event->nb_songs);
+		}
+	}
+
+	if (nb_read < 0) {
+		perror("Failed to read events, please check dmesg");
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	close(fd);
+	return 0;
+}
@@ -4,7 +4,7 @@
 #include "linux/hrtimer.h"
 #include "linux/spinlock.h"
 #include <linux/time.h>
-#include <linux/kthread.h>
+#include <linux/workqueue.h>
 #include <linux/kernel.h>
 #include "player.h"
 #include "hex.h"
@@ -38,31 +38,50 @@ enum PLAYER_STATE {
 enum PLAYER_COMMAND {
 	NONE, // No command
 	PLAY_PAUSE, // Playing or pausing the song
+	PLAY, // Playing the song, nothing if already playing
+	PAUSE, // Pausing the song, nothing if already paused
 	REWIND, // Stop the song
 	NEXT, // Play the next song
 };
 
 struct player_data {
 	struct player *parent;
-	struct task_struct *player_thread;
+	struct work_struct player_work; // one step of the player
 	struct hrtimer player_timer;
-	wait_queue_head_t wait_queue;
-	atomic_t condition;
+	atomic_t nb_ticks; // seconds elapsed since the last step
+	bool stopping; // once set the work is not queued anymore
+	unsigned int outputs; // outputs driven at the last flush
 	enum PLAYER_STATE state;
-	enum PLAYER_COMMAND command;
-	struct music current_song;
+	enum PLAYER_COMMAND command; // raised by the player work itself
+	struct command_ring commands; // sent by the other threads
+	struct stat_spinlock now_playing_lock; // protects the 3 fields below
+	struct song current_song;
 	unsigned int current_duration;
+	uint32_t track_seq; // incremented each time the current song changes
+	uint32_t published_track_seq; // track_seq of the last published event
+	struct drivify_event last_event;
 };
 
-/// @brief The main loop of the player
-/// @param player the player data
-/// @return 0 if no error
-static int run_player(void *player);
+/// @brief One step of the player, it applies the commands, plays and
+/// displays
+/// @param work the work of the player
+/// @note the work never runs concurrently with itself then it is the only
+/// consumer of the commands and the only writer of the shadow registers
+static void run_player(struct work_struct *work);
 
 /// @brief Define the player state
 /// @param data the player data
+/// @param command the command to apply
 /// @note this method is thread safe
-static void define_player_state(struct player_data *data);
+static void define_player_state(struct player_data *data,
+				enum PLAYER_COMMAND command);
+
+/// @brief Send a command to the player work
+/// @param data the player data
+/// @param command the command
+/// @return 0 if no error, -ENOSPC if the command was dropped
+/// @note this method is lock free and never sleeps
+static int send_command(struct player_data *data, enum PLAYER_COMMAND command);
 
 /// @brief Callback of the hrtimer
 /// @param timer the timer
@@ -71,26 +90,43 @@ static void define_player_state(struct player_data *data);
 /// need to be protected by a spinlock because all others spinlocks will save and restore the irq
 static enum hrtimer_restart hrtimer_callback(struct hrtimer *timer);
 
-/// @brief Wake up the player
+/// @brief Advance the current song by the elapsed seconds
 /// @param data the player data
-/// @note this method is thread safe
-static void play(struct player_data *data);
+/// @param nb_ticks the number of seconds elapsed
+/// @note a song that ends is followed by the next one in the same step, at
+/// the exact end of the song
+static void play(struct player_data *data, int nb_ticks);
 
-/// @brief Pause the player
+/// @brief Release the current song
 /// @param data the player data
 static void reset_current_song(struct player_data *data);
 
+/// @brief Display the position in the current song on the hex displays
+/// @param data the player data
+/// @note only the shadow register is changed, see flush_display
+static void display_time(struct player_data *data);
+
 /// @brief Display the number of songs on leds
 /// @param data the player data
-/// @note this method protect the access to the led register
+/// @note only the shadow register is changed, see flush_display
 static void display_nb_songs(struct player_data *data);
 
+/// @brief Write the displays whose shadow register changed
+/// @param data the player data
+/// @note this method is only called by the player work, once per refresh
+static void flush_display(struct player_data *data);
+
 /// @brief Wake up the player
 /// @param data the player data
 static void wake_up_player(struct player_data *data);
 
 static void reset_timer(struct player_data *data);
 
+/// @brief Publish an event if the player changed since the last event
+/// @param data the player data
+/// @note this method is only called by the player work
+static void publish_player_event(struct player_data *data);
+
 int initialize_player(struct player *player)
 {
 	struct player_data *data;
@@ -110,20 +146,28 @@ int initialize_player(struct player *player)
 	}
 
 	data = kmalloc(sizeof(struct player_data), GFP_KERNEL);
-
-	init_waitqueue_head(&data->wait_queue);
-	data->player_thread =
-		kthread_run(run_player, (void *)data, "my_kthread");
-	if (IS_ERR(data->player_thread)) {
-		pr_err("[%s]: Failed to create kthread\n", LIB_NAME);
-		return PTR_ERR(data->player_thread);
+	if (!data) {
+		pr_err("[%s]: Failed to allocate memory for player data\n",
+		       LIB_NAME);
+		return -ENOMEM;
 	}
 
-	atomic_set(&data->condition, 0);
+	init_event_log(&player->events);
+
+	INIT_WORK(&data->player_work, run_player);
+	data->stopping = false;
+	atomic_set(&data->nb_ticks, 0);
+	data->outputs = 0;
 	data->parent = player;
+	clear_song(&data->current_song);
 	data->state = PAUSED;
 	data->command = NONE;
+	init_command_ring(&data->commands);
+	init_stat_spinlock(&data->now_playing_lock);
 	data->current_duration = 0;
+	data->track_seq = 0;
+	data->published_track_seq = 0;
+	memset(&data->last_event, 0, sizeof(struct drivify_event));
 
 	data->parent->data = data;
 
@@ -132,31 +176,107 @@ int initialize_player(struct player *player)
 	data->player_timer.function = hrtimer_callback;
 
 	reset_current_song(data);
-	clear_all_hex_0_3(player->hex_reg);
-	clear_leds(player->led_reg);
-	display_time_3_0(0, data->parent->hex_reg);
-
+	/// the hardware is only written once the player drives an output
+	init_shadow_reg(&player->hex_shadow, player->hex_reg);
+	init_shadow_reg(&player->led_shadow, player->led_reg);
+	shadow_set(&player->hex_shadow, encode_time_3_0(0));
+	shadow_set(&player->led_shadow, 0);
+
+	// the first step is queued once the data is ready because it
+	// publishes events as soon as it runs
+	wake_up_player(data);
 	return 0;
 }
 
 void stop_player(struct player *player)
 {
 	struct player_data *data;
+	unsigned int outputs;
+
 	data = (struct player_data *)player->data;
-	if (data->player_thread) {
-		kthread_stop(data->player_thread);
+	if (data == NULL) {
+		return;
 	}
 
+	/// a running step may start the timer again, the timer is cancelled
+	/// once the work is known to be idle. A callback already running may
+	/// still queue the work, the work is cancelled again once the timer is
+	/// idle, a step queued meanwhile sees stopping and returns
+	WRITE_ONCE(data->stopping, true);
+	cancel_work_sync(&data->player_work);
 	hrtimer_cancel(&data->player_timer);
-	clear_all_hex_0_3(player->hex_reg);
-	clear_leds(player->led_reg);
+	cancel_work_sync(&data->player_work);
+
+	outputs = atomic_read(&player->outputs);
+	if (outputs & OUTPUT_HEX) {
+		shadow_write(&player->hex_shadow, 0);
+	}
+	if (outputs & OUTPUT_LEDS) {
+		shadow_write(&player->led_shadow, 0);
+	}
+
+	reset_current_song(data);
+	player->data = NULL;
+	kfree(data);
+}
 
-	if (data != NULL) {
-		kfree(data);
+struct player *create_player(unsigned int id, void __iomem *hex_reg,
+			     void __iomem *led_reg)
+{
+	struct player *player;
+
+	player = kzalloc(sizeof(struct player), GFP_KERNEL);
+	if (!player) {
+		pr_err("[%s]: Error allocating player\n", LIB_NAME);
+		return NULL;
+	}
+
+	player->playlist = kzalloc(sizeof(struct playlist), GFP_KERNEL);
+	if (!player->playlist) {
+		pr_err("[%s]: Error allocating playlist\n", LIB_NAME);
+		goto ERR_PLAYLIST_HEAD;
 	}
+
+	/// each player has its own strings so that its budget only counts its
+	/// songs and a full player never blocks the writers of another one
+	init_str_pool(&player->pool);
+	init_stat_spinlock(&player->queue_lock);
+	if (init_playlist(player->playlist, &player->pool)) {
+		pr_err("[%s]: Error allocating playlist ring\n", LIB_NAME);
+		goto ERR_PLAYLIST_RING;
+	}
+
+	player->id = id;
+	player->hex_reg = hex_reg;
+	player->led_reg = led_reg;
+	atomic_set(&player->outputs, 0);
+	if (initialize_player(player)) {
+		goto ERR_PLAYER;
+	}
+
+	pr_info("[%s]: Player %u created with a budget of %zu bytes\n",
+		LIB_NAME, id, player->playlist->budget);
+	return player;
+
+ERR_PLAYER:
+	free_playlist(player->playlist, &player->queue_lock);
+ERR_PLAYLIST_RING:
+	destroy_str_pool(&player->pool);
+	kfree(player->playlist);
+ERR_PLAYLIST_HEAD:
+	kfree(player);
+	return NULL;
 }
 
-void get_current_song(struct player *player, struct music *music_dest)
+void destroy_player(struct player *player)
+{
+	free_playlist(player->playlist, &player->queue_lock);
+	destroy_str_pool(&player->pool);
+	kfree(player->playlist);
+	kfree(player);
+}
+
+void get_current_song(struct player *player, struct song *song_dest)
 {
 	struct player_data *data;
 	unsigned long irq_flags;
@@ -173,48 +293,69 @@ void get_current_song(struct player *player, struct music *music_dest)
 		return;
 	}
 
-	spin_lock_irqsave(&player->playlist_lock, irq_flags);
-	memcpy(music_dest, &data->current_song, sizeof(struct music));
-	spin_unlock_irqrestore(&player->playlist_lock, irq_flags);
+	stat_spin_lock_irqsave(&data->now_playing_lock, irq_flags);
+	*song_dest = data->current_song;
+	get_song(song_dest);
+	stat_spin_unlock_irqrestore(&data->now_playing_lock, irq_flags);
 }
 
-void get_nb_songs(struct player *player, uint8_t *nb_songs)
+int set_current_song(struct player *player, struct song *song,
+		     uint32_t current_duration)
 {
 	struct player_data *data;
+	unsigned long irq_flags;
+
+	if (!player) {
+		pr_err("[%s]: Player is NULL\n", LIB_NAME);
+		return -1;
+	}
+
 	data = (struct player_data *)player->data;
-	/// note that kfifo_len is thread safe
+	if (!data) {
+		pr_err("[%s]: Data is NULL\n", LIB_NAME);
+		return -1;
+	}
+
+	if (song && current_duration > song->duration) {
+		pr_err("[%s]: Current duration is greater than the song duration\n",
+		       LIB_NAME);
+		return -1;
+	}
+
+	stat_spin_lock_irqsave(&data->now_playing_lock, irq_flags);
+	if (song) {
+		reset_current_song(data);
+		data->current_song = *song;
+		data->current_duration = current_duration;
+	} else {
+		reset_current_song(data);
+		data->current_duration = 0;
+	}
+	stat_spin_unlock_irqrestore(&data->now_playing_lock, irq_flags);
+	wake_up_player(data);
+	return 0;
+}
+
+void get_nb_songs(struct player *player, uint32_t *nb_songs)
+{
+	struct player_data *data;
+	data = (struct player_data *)player->data;
+	/// note that get_playlist_len is thread safe
 	if (data->current_song.duration != 0) {
-		*nb_songs = kfifo_len(data->parent->playlist) /
-				    sizeof(struct music) +
+		*nb_songs = get_playlist_len(data->parent->playlist) +
 			    1; // +1 because the current song is in the count
 	} else {
-		*nb_songs = kfifo_len(data->parent->playlist) /
-			    sizeof(struct music);
+		*nb_songs = get_playlist_len(data->parent->playlist);
 	}
 }
 
 void get_total_duration(struct player *player, uint32_t *total_duration)
 {
 	struct player_data *data;
-	struct kfifo playlist;
-	int nb_songs;
-	struct music song;
-	int ret;
-	unsigned long irq_flags;
 
 	data = (struct player_data *)player->data;
-
-	spin_lock_irqsave(&player->playlist_lock, irq_flags);
-	memcpy(&playlist, data->parent->playlist, sizeof(struct kfifo));
-	spin_unlock_irqrestore(&player->playlist_lock, irq_flags);
-
-	nb_songs = kfifo_len(&playlist) / sizeof(struct music);
-	for (int i = 0; i < nb_songs; i++) {
-		// this kfifo is local then it is not necessary to protect it
-		ret = kfifo_out(&playlist, &song, sizeof(struct music));
-		*total_duration += song.duration;
-	}
-
+	*total_duration =
+		get_playlist_duration(player->playlist, &player->queue_lock);
 	*total_duration += data->current_song.duration - data->current_duration;
 }
 
@@ -264,12 +405,12 @@ int set_current_duration(struct player *player, uint32_t current_duration)
 		return -1;
 	}
 
-	spin_lock_irqsave(&player->playlist_lock, irq_flags);
+	stat_spin_lock_irqsave(&data->now_playing_lock, irq_flags);
 	data->current_duration = current_duration;
-	atomic_set(&data->condition, 1);
-	wake_up_interruptible(&data->wait_queue);
+	stat_spin_unlock_irqrestore(&data->now_playing_lock, irq_flags);
+	/// the hrtimer has its own lock
 	reset_timer(data);
-	spin_unlock_irqrestore(&player->playlist_lock, irq_flags);
+	wake_up_player(data);
 	return 0;
 }
 
@@ -278,22 +419,23 @@ void do_play(struct player *player)
 	struct player_data *data;
 
 	data = (struct player_data *)player->data;
-
-	if (data->state == PAUSED) {
-		play_pause_song(player);
-		return;
-	}
+	send_command(data, PLAY);
 }
 
 void do_pause(struct player *player)
 {
 	struct player_data *data;
+
 	data = (struct player_data *)player->data;
+	send_command(data, PAUSE);
+}
 
-	if (data->state == PLAYING) {
-		play_pause_song(player);
-		return;
-	}
+void get_command_stats(struct player *player, struct command_stats *stats)
+{
+	struct player_data *data;
+
+	data = (struct player_data *)player->data;
+	get_command_ring_stats(&data->commands, stats);
 }
 
 int get_player_state(struct player *player)
@@ -322,13 +464,15 @@ int get_player_state(struct player *player)
 
 static void wake_up_player(struct player_data *data)
 {
-	atomic_set(&data->condition, 1);
-	wake_up_interruptible(&data->wait_queue);
+	if (!READ_ONCE(data->stopping)) {
+		queue_work(system_wq, &data->player_work);
+	}
 }
 
 static void reset_timer(struct player_data *data)
 {
 	hrtimer_cancel(&data->player_timer);
+	atomic_set(&data->nb_ticks, 0);
 	hrtimer_start(&data->player_timer, ns_to_ktime(TIMER_INTERVAL_NS),
 		      HRTIMER_MODE_REL);
 }
@@ -338,148 +482,246 @@ static enum hrtimer_restart hrtimer_callback(struct hrtimer *timer)
 	struct player_data *data;
 	data = container_of(timer, struct player_data, player_timer);
 
-	atomic_set(&data->condition, 1);
-	wake_up_interruptible(&data->wait_queue);
+	if (READ_ONCE(data->stopping)) {
+		return HRTIMER_NORESTART;
+	}
+	/// only the ticks advance the song, not the other wake ups
+	atomic_inc(&data->nb_ticks);
+	wake_up_player(data);
 	hrtimer_forward_now(
 		timer, ns_to_ktime(TIMER_INTERVAL_NS)); // Restart the timer
 	return HRTIMER_RESTART;
 }
 
-static int run_player(void *player_data)
+static int send_command(struct player_data *data, enum PLAYER_COMMAND command)
+{
+	int ret;
+
+	ret = push_command(&data->commands, command);
+	wake_up_player(data);
+	return ret;
+}
+
+static void run_player(struct work_struct *work)
 {
 	struct player_data *data;
+	enum PLAYER_COMMAND command;
+	uint8_t sent_command;
+	int nb_ticks;
 
-	data = (struct player_data *)player_data;
-	while (!kthread_should_stop()) {
-		wait_event_interruptible(data->wait_queue,
-					 atomic_read(&data->condition) ||
-						 kthread_should_stop());
-		define_player_state(data);
-		if (data->state == PLAYING) {
-			play(data);
-		}
+	data = container_of(work, struct player_data, player_work);
+	if (READ_ONCE(data->stopping)) {
+		return;
+	}
+
+	/// the ticks of a late step are all counted, the position does not drift
+	nb_ticks = atomic_xchg(&data->nb_ticks, 0);
 
-		display_time_3_0(data->current_duration, data->parent->hex_reg);
-		display_nb_songs(data);
-		atomic_set(&data->condition, 0); // Reset the condition
+	/// every command is applied in the order it was sent
+	while (pop_command(&data->commands, &sent_command)) {
+		define_player_state(data, sent_command);
 	}
-	return 0;
+	if (data->command != NONE) {
+		command = data->command;
+		data->command = NONE;
+		define_player_state(data, command);
+	}
+	if (data->state == PLAYING) {
+		play(data, nb_ticks);
+	}
+
+	display_time(data);
+	display_nb_songs(data);
+	flush_display(data);
+	publish_player_event(data);
 }
 
-static void play(struct player_data *data)
+static void play(struct player_data *data, int nb_ticks)
 {
 	unsigned long flags;
+	unsigned long queue_flags;
+	struct song next_song;
+	int ret;
 
-	/// This condition will lock the whole bloc of the if to be more efficient
-	if (data->current_duration >= data->current_song.duration) {
-		spin_lock_irqsave(&data->parent->playlist_lock, flags);
+	/// a tick only takes the now playing lock, the queue is only locked
+	/// when the song ends
+	stat_spin_lock_irqsave(&data->now_playing_lock, flags);
+	for (; nb_ticks > 0; nb_ticks--) {
+		data->current_duration++;
+		if (data->current_duration < data->current_song.duration) {
+			continue;
+		}
+
+		/// the next song replaces the ended one without waiting for
+		/// another tick, its first second starts right now
+		stat_spin_lock_irqsave(&data->parent->queue_lock, queue_flags);
+		ret = get_next_music_locked(data->parent->playlist,
+					    &data->current_song, false,
+					    &next_song);
+		stat_spin_unlock_irqrestore(&data->parent->queue_lock,
+					    queue_flags);
 		data->current_duration = 0;
-		if (kfifo_is_empty(data->parent->playlist)) {
-			reset_current_song(data);
-			data->command = PLAY_PAUSE;
-			spin_unlock_irqrestore(&data->parent->playlist_lock,
-					       flags);
-			pr_info("[%s]: Playlist is empty\n", LIB_NAME);
-			return;
+		reset_current_song(data);
+		if (ret != 0) {
+			data->command = PAUSE;
+			pr_debug("[%s]: Playlist is empty\n", LIB_NAME);
+			break;
 		}
-		data->command = NEXT;
-		spin_unlock_irqrestore(&data->parent->playlist_lock, flags);
-		return;
+		data->current_song = next_song;
 	}
-
-	data->current_duration++;
+	stat_spin_unlock_irqrestore(&data->now_playing_lock, flags);
 }
 
 static void reset_current_song(struct player_data *data)
 {
-	data->current_song.duration = 0;
-	data->current_song.name[0] = '\0';
-	data->current_song.artist[0] = '\0';
+	data->track_seq++;
+	release_song(&data->parent->pool, &data->current_song);
+	// the strings of the song may be freed, a writer may have space again
+	wake_up_interruptible(&data->parent->playlist->space_wait_queue);
+}
+
+static void display_time(struct player_data *data)
+{
+	shadow_set(&data->parent->hex_shadow,
+		   encode_time_3_0(data->current_duration));
 }
 
 static void display_nb_songs(struct player_data *data)
 {
-	uint8_t nb_songs;
-	unsigned long irq_flags;
+	uint32_t nb_songs;
 	get_nb_songs(data->parent, &nb_songs);
 
-	spin_lock_irqsave(&data->parent->playlist_lock, irq_flags);
-	leds_down(LEDS_SONGS, data->parent->led_reg);
-	leds_up(nb_songs & LEDS_SONGS, data->parent->led_reg);
-	spin_unlock_irqrestore(&data->parent->playlist_lock, irq_flags);
+	shadow_update(&data->parent->led_shadow, LEDS_SONGS, nb_songs);
+}
+
+static void flush_display(struct player_data *data)
+{
+	unsigned int outputs;
+
+	/// an output just routed to the player is fully rewritten because
+	/// another player drove it meanwhile
+	outputs = atomic_read(&data->parent->outputs);
+	if (outputs & ~data->outputs & OUTPUT_HEX) {
+		shadow_write(&data->parent->hex_shadow,
+			     data->parent->hex_shadow.value);
+	} else if (outputs & OUTPUT_HEX) {
+		shadow_flush(&data->parent->hex_shadow);
+	}
+	if (outputs & ~data->outputs & OUTPUT_LEDS) {
+		shadow_write(&data->parent->led_shadow,
+			     data->parent->led_shadow.value);
+	} else if (outputs & OUTPUT_LEDS) {
+		shadow_flush(&data->parent->led_shadow);
+	}
+	data->outputs = outputs;
 }
 
-static void define_player_state(struct player_data *data)
+static void publish_player_event(struct player_data *data)
+{
+	struct drivify_event event;
+	uint32_t nb_songs;
+
+	get_nb_songs(data->parent, &nb_songs);
+	event.position = data->current_duration;
+	event.duration = data->current_song.duration;
+	event.state = data->state == PLAYING;
+	event.nb_songs = min_t(uint32_t, nb_songs, U16_MAX);
+	event.flags = 0;
+
+	if (data->track_seq != data->published_track_seq) {
+		event.flags |= EVENT_TRACK;
+	}
+	if (event.state != data->last_event.state) {
+		event.flags |= EVENT_STATE;
+	}
+	if (event.position != data->last_event.position) {
+		event.flags |= EVENT_POSITION;
+	}
+
+	// a song added to the playlist has no flag but is still worth an event
+	if (event.flags == 0 && event.nb_songs == data->last_event.nb_songs) {
+		return;
+	}
+
+	data->published_track_seq = data->track_seq;
+	publish_event(&data->parent->events, &event);
+	data->last_event = event;
+}
+
+static void define_player_state(struct player_data *data,
+				enum PLAYER_COMMAND command)
 {
 	int ret;
 	unsigned long irq_flags;
-	struct music next_music;
-
-	/// note that if we lock a part of code, we use break and we unlock the code at the end.
-	/// if we doesn't lock the code, we use return to exit the method
-	switch (data->command) {
-	case PLAY_PAUSE:
-		switch (data->state) {
-		case PLAYING:
-			pr_info("[%s]: Pausing\n", LIB_NAME);
-			data->state = PAUSED;
-			spin_lock_irqsave(&data->parent->playlist_lock,
-					  irq_flags);
-			led_down(LED_PLAYING, data->parent->led_reg);
-			hrtimer_cancel(&data->player_timer);
-			break;
-		case PAUSED:
-			pr_info("[%s]: Playing :[%s]\n", LIB_NAME,
-				data->current_song.name);
-
-			data->state = PLAYING;
-			spin_lock_irqsave(&data->parent->playlist_lock,
-					  irq_flags);
-			led_up(LED_PLAYING, data->parent->led_reg);
-			hrtimer_start(&data->player_timer,
-				      ns_to_ktime(TIMER_INTERVAL_NS),
-				      HRTIMER_MODE_REL);
-			break;
-		default:
-			break;
+	unsigned long queue_flags;
+	struct song next_song;
+
+	if (command == PLAY_PAUSE) {
+		command = data->state == PLAYING ? PAUSE : PLAY;
+	}
+
+	/// the state, the timer and the shadow registers need no lock, only the
+	/// work changes them (the hrtimer has its own lock). The now playing
+	/// lock is always taken before the queue lock.
+	switch (command) {
+	case PAUSE:
+		if (data->state != PLAYING) {
+			return;
 		}
+		pr_debug("[%s]: Pausing\n", LIB_NAME);
+		data->state = PAUSED;
+		shadow_update(&data->parent->led_shadow, BIT(LED_PLAYING), 0);
+		hrtimer_cancel(&data->player_timer);
+		break;
+	case PLAY:
+		if (data->state != PAUSED) {
+			return;
+		}
+		pr_debug("[%s]: Playing :[%s]\n", LIB_NAME,
+			 song_name(&data->current_song));
+
+		data->state = PLAYING;
+		shadow_update(&data->parent->led_shadow, BIT(LED_PLAYING),
+			      BIT(LED_PLAYING));
+		atomic_set(&data->nb_ticks, 0);
+		hrtimer_start(&data->player_timer,
+			      ns_to_ktime(TIMER_INTERVAL_NS), HRTIMER_MODE_REL);
 		break;
 	case REWIND:
-		spin_lock_irqsave(&data->parent->playlist_lock, irq_flags);
+		stat_spin_lock_irqsave(&data->now_playing_lock, irq_flags);
 		data->current_duration = 0;
+		stat_spin_unlock_irqrestore(&data->now_playing_lock, irq_flags);
 		reset_timer(data);
 		break;
 
 	case NEXT:
-		spin_lock_irqsave(&data->parent->playlist_lock, irq_flags);
-		ret = kfifo_out(data->parent->playlist, &next_music,
-				sizeof(struct music));
-		if (ret == sizeof(struct music)) {
+		stat_spin_lock_irqsave(&data->now_playing_lock, irq_flags);
+		stat_spin_lock_irqsave(&data->parent->queue_lock, queue_flags);
+		ret = get_next_music_locked(data->parent->playlist,
+					    &data->current_song, true,
+					    &next_song);
+		stat_spin_unlock_irqrestore(&data->parent->queue_lock,
+					    queue_flags);
+		if (ret == 0) {
 			data->current_duration = 0;
-			memcpy(&data->current_song, &next_music,
-			       sizeof(struct music));
-			break;
+			reset_current_song(data);
+			data->current_song = next_song;
 		} else {
-			pr_info("[%s]: Playlist is empty\n", LIB_NAME);
-			break;
+			pr_debug("[%s]: Playlist is empty\n", LIB_NAME);
 		}
+		stat_spin_unlock_irqrestore(&data->now_playing_lock, irq_flags);
+		break;
 	case NONE:
-		//never spinlocked
 		return;
 	default:
-		//never spinlocked
 		pr_err("[%s]: Invalid command\n", LIB_NAME);
 		return;
 	}
-
-	data->command = NONE;
-	spin_unlock_irqrestore(&data->parent->playlist_lock, irq_flags);
 }
 
 int play_pause_song(struct player *player)
 {
 	struct player_data *data;
-	unsigned long flags;
 
 	if (!player) {
 		pr_err("[%s]: Player is NULL\n", LIB_NAME);
@@ -487,19 +729,12 @@ int play_pause_song(struct player *player)
 	}
 
 	data = (struct player_data *)player->data;
-
-	spin_lock_irqsave(&player->playlist_lock, flags);
-	data->command = PLAY_PAUSE;
-	wake_up_player(data);
-	spin_unlock_irqrestore(&player->playlist_lock, flags);
-
-	return 0;
+	return send_command(data, PLAY_PAUSE);
 }
 
 int rewind_song(struct player *player)
 {
 	struct player_data *data;
-	unsigned long irq_flags;
 
 	if (!player) {
 		pr_err("[%s]: Player is NULL\n", LIB_NAME);
@@ -507,18 +742,13 @@ int rewind_song(struct player *player)
 	}
 
 	data = (struct player_data *)player->data;
-	spin_lock_irqsave(&player->playlist_lock, irq_flags);
-	data->command = REWIND;
-	wake_up_player(data);
-	spin_unlock_irqrestore(&player->playlist_lock, irq_flags);
-
-	return 0;
+	return send_command(data, REWIND);
 }
 
 int next_song(struct player *player)
 {
-	unsigned long irq_flags;
 	struct player_data *data;
+	int ret;
 
 	if (!player) {
 		pr_err("[%s]: Player is NULL\n", LIB_NAME);
@@ -526,21 +756,14 @@ int next_song(struct player *player)
 	}
 	data = (struct player_data *)player->data;
 
-	/// This part protect a bloc of code to be more efficient
-	spin_lock_irqsave(&player->playlist_lock, irq_flags);
-	data->command = NEXT;
-	if (!kfifo_is_empty(player->playlist)) {
-		wake_up_player(data);
-	}
-	spin_unlock_irqrestore(&player->playlist_lock, irq_flags);
+	ret = send_command(data, NEXT);
 	reset_timer(data);
-	return 0;
+	return ret;
 }
 
 void refresh_player(struct player *player)
 {
 	struct player_data *data;
-	unsigned long irq_flags;
 
 	if (!player) {
 		pr_err("[%s]: Player is NULL\n", LIB_NAME);
@@ -548,8 +771,6 @@ void refresh_player(struct player *player)
 	}
 	data = (struct player_data *)player->data;
 	if (data->state == PAUSED) {
-		spin_lock_irqsave(&player->playlist_lock, irq_flags);
 		wake_up_player(data);
-		spin_unlock_irqrestore(&player->playlist_lock, irq_flags);
 	}
 }
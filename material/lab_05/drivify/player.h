@@ -3,55 +3,82 @@
 
 #include "drivify_shared_types.h"
 #include <linux/kfifo.h>
-#include "music.h"
+#include "commands.h"
+#include "song.h"
 
 /// @brief Add a new player to the playlist
 /// @param player the player to initialize
 /// @return 0 if no error
-/// @note this method is called on the probe method then it is thread safe
+/// @note this method is called once per player before it is published then it is thread safe
 int initialize_player(struct player *player);
 
 /// @brief Stop the player
 /// @param player the player to stop
+/// @note once stopped the timer and the work of the player never run again
 void stop_player(struct player *player);
 
+/// @brief Allocate a player, its playlist and start it
+/// @param id the number of the player
+/// @param hex_reg the register of the hex displays
+/// @param led_reg the register of the leds
+/// @return the player or NULL on error
+/// @note the player drives no output until some are routed to it
+struct player *create_player(unsigned int id, void __iomem *hex_reg,
+			     void __iomem *led_reg);
+
+/// @brief Free a stopped player and its playlist
+/// @param player the player to free
+void destroy_player(struct player *player);
+
 /// @brief Play the next song
 /// @param player the player
-/// @return 0 if no error
+/// @return 0 if no error, -ENOSPC if the command was dropped
+/// @note the command is queued for the player work without lock
 int next_song(struct player *player);
 
 /// @brief Rewind the current song
 /// @param player the player
-/// @return 0 if no error
-/// @note this method use a spinlock to protect the current song duration and to wake up the player thread
+/// @return 0 if no error, -ENOSPC if the command was dropped
+/// @note the command is queued for the player work without lock
 int rewind_song(struct player *player);
 
 /// @brief Play or pause the current song
 /// @param player the player
-/// @return 0 if no error
-/// @note this method use a spinlock to protect the current song duration and to wake up the player thread
+/// @return 0 if no error, -ENOSPC if the command was dropped
+/// @note the command is queued for the player work without lock
 int play_pause_song(struct player *player);
 
 /// @brief Refresh the player
 /// @param player the player
-/// @note this method use a spinlock to protect the current song duration and to wake up the player thread
+/// @note this method use a spinlock to protect the current song duration and to wake up the player work
 void refresh_player(struct player *player);
 
 /// @brief Get the current song
 /// @param player the player
-/// @param music the buffer to store the song
+/// @param song the buffer to store the song, it must be released by the caller
 /// @note in this method a spinlock is used to protect the current song when it memcopied, the irq will be saved and restored
-void get_current_song(struct player *player, struct music *music);
+void get_current_song(struct player *player, struct song *song);
+
+/// @brief Replace the current song
+/// @param player the player
+/// @param song the new current song, NULL to clear the current song. The
+/// player takes the references of the song on success
+/// @param current_duration the number of seconds already played of the song
+/// @return 0 if no error -1 if error
+/// @note the current duration must be less than the duration of the song
+/// @note this use a spinlock to protect the current song of the player
+int set_current_song(struct player *player, struct song *song,
+		     uint32_t current_duration);
 
 /// @brief get the number of songs in the playlist of the player
 /// @param player the player
 /// @param nb_songs the buffer to store the number of songs
-void get_nb_songs(struct player *player, uint8_t *nb_songs);
+void get_nb_songs(struct player *player, uint32_t *nb_songs);
 
 /// @brief get the total duration of the playlist of the player
 /// @param player the player
 /// @param total_duration the buffer to store the total duration
-/// @note in this method a spinlock is used to protect the playlist when it memcopied, the irq will be saved and restored
+/// @note in this method a spinlock is used to protect the playlist while it is summed, the irq will be saved and restored
 void get_total_duration(struct player *player, uint32_t *total_duration);
 
 /// @brief get the current duration of the player
@@ -75,12 +102,17 @@ int get_player_state(struct player *player);
 
 /// @brief play the current song
 /// @param player the player
-/// @note this method is thread safe because it will use thread safe methods
+/// @note the command is queued for the player work without lock
 void do_play(struct player *player);
 
 /// @brief pause the current song
 /// @param player the player
-/// @note this method is thread safe because it will use thread safe methods
+/// @note the command is queued for the player work without lock
 void do_pause(struct player *player);
 
+/// @brief get the counters of the commands sent to the player
+/// @param player the player
+/// @param stats the buffer to store the counters
+void get_command_stats(struct player *player, struct command_stats *stats);
+
 #endif // PLAYER_H
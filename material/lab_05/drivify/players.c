@@ -0,0 +1,123 @@
+#include "players.h"
+#include "player.h"
+#include "drivify_sysfs.h"
+#include <linux/printk.h>
+
+#define LIB_NAME "players"
+
+int add_player(struct priv *priv)
+{
+	struct player *player;
+	unsigned int id;
+	int err;
+
+	mutex_lock(&priv->players_lock);
+	id = priv->nb_players;
+	if (id == DRIVIFY_MAX_PLAYERS) {
+		pr_err("[%s]: No more than %d players\n", LIB_NAME,
+		       DRIVIFY_MAX_PLAYERS);
+		err = -ENOSPC;
+		goto out;
+	}
+
+	player = create_player(id, priv->regs->hex_0_3_reg,
+			       priv->regs->led_reg);
+	if (!player) {
+		err = -ENOMEM;
+		goto out;
+	}
+	player->priv = priv;
+	if (id == 0) {
+		atomic_set(&player->outputs, OUTPUT_ALL);
+	}
+
+	err = init_player_sysfs(player, &priv->dev->kobj);
+	if (err) {
+		stop_player(player);
+		destroy_player(player);
+		goto out;
+	}
+
+	/// the player is published once it is ready, the readers do not lock
+	priv->players[id] = player;
+	smp_store_release(&priv->nb_players, id + 1);
+	err = id;
+out:
+	mutex_unlock(&priv->players_lock);
+	return err;
+}
+
+struct player *get_player(struct priv *priv, unsigned int id)
+{
+	if (id >= get_nb_players(priv)) {
+		return NULL;
+	}
+	return priv->players[id];
+}
+
+unsigned int get_nb_players(struct priv *priv)
+{
+	return smp_load_acquire(&priv->nb_players);
+}
+
+void set_player_outputs(struct player *player, unsigned int outputs)
+{
+	struct priv *priv = player->priv;
+
+	outputs &= OUTPUT_ALL;
+	mutex_lock(&priv->players_lock);
+	for (unsigned int i = 0; i < priv->nb_players; i++) {
+		if (priv->players[i] != player) {
+			atomic_andnot(outputs, &priv->players[i]->outputs);
+		}
+	}
+	atomic_set(&player->outputs, outputs);
+	mutex_unlock(&priv->players_lock);
+
+	// the player writes its outputs at its next step
+	refresh_player(player);
+	pr_info("[%s]: Outputs 0x%x routed to player %u\n", LIB_NAME, outputs,
+		player->id);
+}
+
+struct player *get_keys_player(struct priv *priv)
+{
+	unsigned int nb_players = get_nb_players(priv);
+
+	for (unsigned int i = 0; i < nb_players; i++) {
+		if (atomic_read(&priv->players[i]->outputs) & OUTPUT_KEYS) {
+			return priv->players[i];
+		}
+	}
+	return NULL;
+}
+
+void stop_players(struct priv *priv)
+{
+	struct player *player;
+
+	/// the sysfs directories are removed without the lock because the
+	/// removal waits for the attributes in use, which may take the lock.
+	/// No player is added anymore once the device is not running.
+	for (unsigned int i = 0; i < priv->nb_players; i++) {
+		remove_player_sysfs(priv->players[i]);
+	}
+
+	mutex_lock(&priv->players_lock);
+	for (unsigned int i = 0; i < priv->nb_players; i++) {
+		player = priv->players[i];
+		wake_up_interruptible(&player->events.wait_queue);
+		wake_up_interruptible(&player->playlist->space_wait_queue);
+		stop_player(player);
+	}
+	mutex_unlock(&priv->players_lock);
+}
+
+void destroy_players(struct priv *priv)
+{
+	for (unsigned int i = 0; i < priv->nb_players; i++) {
+		destroy_player(priv->players[i]);
+		priv->players[i] = NULL;
+	}
+	priv->nb_players = 0;
+}
@@ -0,0 +1,43 @@
+#ifndef PLAYERS_H
+#define PLAYERS_H
+
+#include "drivify_shared_types.h"
+
+/// @brief Create a new player on the device
+/// @param priv the private structure of the device
+/// @return the number of the player or a negative error code
+/// @note the first player gets all the outputs
+int add_player(struct priv *priv);
+
+/// @brief Get a player of the device
+/// @param priv the private structure of the device
+/// @param id the number of the player
+/// @return the player or NULL if it does not exist
+/// @note this method is lock free, a player is never removed before the device
+struct player *get_player(struct priv *priv, unsigned int id);
+
+/// @brief Get the number of players of the device
+/// @param priv the private structure of the device
+/// @return the number of players
+unsigned int get_nb_players(struct priv *priv);
+
+/// @brief Route outputs to a player, the outputs are taken from the others
+/// @param player the player
+/// @param outputs the mask of OUTPUT_* the player drives from now on
+void set_player_outputs(struct player *player, unsigned int outputs);
+
+/// @brief Get the player controlled by the keys
+/// @param priv the private structure of the device
+/// @return the player or NULL if the keys are routed to none
+struct player *get_keys_player(struct priv *priv);
+
+/// @brief Stop all the players of the device
+/// @param priv the private structure of the device
+/// @note the players are only freed with the device, see destroy_players
+void stop_players(struct priv *priv);
+
+/// @brief Free all the players of the device
+/// @param priv the private structure of the device
+void destroy_players(struct priv *priv);
+
+#endif // PLAYERS_H
@@ -1,38 +1,228 @@
-#include "linux/kfifo.h"
 #include "linux/printk.h"
-#include "music.h"
 #include "playlist.h"
 #include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/random.h>
 #include <linux/string.h>
 
 #define LIB_NAME "playlist"
 
-bool is_initilized_playlist(struct kfifo *playlist)
+static const char *const MODE_NAMES[NB_PLAYLIST_MODES] = {
+	[PLAYLIST_FIFO] = "fifo",
+	[PLAYLIST_REPEAT_ONE] = "repeat-one",
+	[PLAYLIST_REPEAT_ALL] = "repeat-all",
+	[PLAYLIST_SHUFFLE] = "shuffle",
+	[PLAYLIST_PRIORITY] = "priority",
+};
+
+/// @brief Get the song at a position of a ring
+/// @param ring The ring, the lock of its playlist must be held
+/// @param index The position in the ring, 0 is the first song
+/// @return the song
+static struct song *song_at(struct song_ring *ring, unsigned int index)
+{
+	return &ring->songs[(ring->first + index) & (ring->capacity - 1)];
+}
+
+/// @brief Get the song at a position of a playlist, priority songs first
+/// @param playlist The playlist, its lock must be held
+/// @param index The position in the playlist, 0 is the next song
+/// @return the song
+static struct song *playlist_song_at(struct playlist *playlist,
+				     unsigned int index)
+{
+	if (index < playlist->priority.nb_songs) {
+		return song_at(&playlist->priority, index);
+	}
+	return song_at(&playlist->queue, index - playlist->priority.nb_songs);
+}
+
+/// @brief Add a song at the end of a ring which is not full
+static void push_song(struct playlist *playlist, struct song_ring *ring,
+		      struct song *song)
+{
+	*song_at(ring, ring->nb_songs) = *song;
+	ring->nb_songs++;
+	WRITE_ONCE(playlist->nb_songs, playlist->nb_songs + 1);
+}
+
+/// @brief Remove the first song of a ring which is not empty
+static void pop_song(struct playlist *playlist, struct song_ring *ring,
+		     struct song *song)
+{
+	*song = *song_at(ring, 0);
+	ring->first = (ring->first + 1) & (ring->capacity - 1);
+	ring->nb_songs--;
+	WRITE_ONCE(playlist->nb_songs, playlist->nb_songs - 1);
+}
+
+/// @brief Allocate the array of a ring
+/// @param ring The ring to initialize
+/// @param capacity The capacity of the ring, a power of 2
+/// @return 0 if no error
+static int alloc_ring(struct song_ring *ring, unsigned int capacity)
+{
+	ring->songs = kvmalloc_array(capacity, sizeof(struct song),
+				     GFP_KERNEL);
+	if (!ring->songs) {
+		return -ENOMEM;
+	}
+	ring->capacity = capacity;
+	ring->first = 0;
+	ring->nb_songs = 0;
+	return 0;
+}
+
+/// @brief Move the songs of a ring to a new array
+/// @param ring The ring, the lock of its playlist must be held
+/// @param songs The new array, it must hold at least nb_songs songs
+/// @param capacity The capacity of the new array
+/// @return the old array to free once the lock is released
+static struct song *swap_ring(struct song_ring *ring, struct song *songs,
+			      unsigned int capacity)
+{
+	struct song *old_songs;
+
+	for (unsigned int i = 0; i < ring->nb_songs; i++) {
+		songs[i] = *song_at(ring, i);
+	}
+	old_songs = ring->songs;
+	ring->songs = songs;
+	ring->capacity = capacity;
+	ring->first = 0;
+	return old_songs;
+}
+
+/// @brief Find the ring to grow before a song can be added to a ring
+/// @param playlist The playlist, its lock must be held
+/// @param target The ring which receives the song
+/// @param capacity The capacity needed for the returned ring
+/// @return the ring to grow or NULL if the song can be added
+/// @note the queue can always take back every song and the current one,
+/// this way repeat-all never has to allocate on a track change
+static struct song_ring *ring_to_grow(struct playlist *playlist,
+				      struct song_ring *target,
+				      unsigned int *capacity)
+{
+	if (target->nb_songs == target->capacity) {
+		*capacity = target->capacity * 2;
+		return target;
+	}
+	if (playlist->queue.capacity < playlist->nb_songs + 2) {
+		*capacity = roundup_pow_of_two(playlist->nb_songs + 2);
+		return &playlist->queue;
+	}
+	return NULL;
+}
+
+int init_playlist(struct playlist *playlist, struct str_pool *pool)
+{
+	if (alloc_ring(&playlist->queue, PLAYLIST_MIN_CAPACITY) ||
+	    alloc_ring(&playlist->priority, PLAYLIST_MIN_CAPACITY)) {
+		pr_err("[%s]: Failed to allocate the playlist\n", LIB_NAME);
+		kvfree(playlist->queue.songs);
+		playlist->queue.songs = NULL;
+		return -ENOMEM;
+	}
+	playlist->nb_songs = 0;
+	playlist->mode = PLAYLIST_FIFO;
+	playlist->budget = PLAYLIST_DEFAULT_BUDGET;
+	playlist->pool = pool;
+	init_waitqueue_head(&playlist->space_wait_queue);
+	return 0;
+}
+
+void free_playlist(struct playlist *playlist,
+		    struct stat_spinlock *playlist_lock)
+{
+	clear_playlist(playlist, playlist_lock);
+	kvfree(playlist->queue.songs);
+	kvfree(playlist->priority.songs);
+	playlist->queue.songs = NULL;
+	playlist->priority.songs = NULL;
+}
+
+bool is_initilized_playlist(struct playlist *playlist)
 {
 	if (playlist == NULL) {
 		pr_err("[%s]: Playlist is NULL\n", LIB_NAME);
 		return false;
 	}
 
-	if (!kfifo_initialized(playlist)) {
+	if (playlist->queue.songs == NULL) {
 		pr_err("[%s]: Playlist is not initialized\n", LIB_NAME);
 		return false;
 	}
 	return true;
 }
 
-int set_music_to_playlist(struct kfifo *playlist, struct music *music,
-			  spinlock_t *playlist_lock)
+unsigned int get_playlist_len(struct playlist *playlist)
 {
-	int ret;
-	int nb_elements;
+	return READ_ONCE(playlist->nb_songs);
+}
+
+size_t get_playlist_memory(struct playlist *playlist)
+{
+	/// the rings never shrink, only the songs they hold are charged so that
+	/// an emptied playlist goes back under any budget
+	return READ_ONCE(playlist->nb_songs) * sizeof(struct song) +
+	       READ_ONCE(playlist->pool->nb_bytes);
+}
+
+void set_playlist_budget(struct playlist *playlist, size_t budget)
+{
+	WRITE_ONCE(playlist->budget, budget);
+	// a bigger budget may let the writers continue
+	wake_up_interruptible(&playlist->space_wait_queue);
+}
+
+const char *playlist_mode_name(enum playlist_mode mode)
+{
+	if (mode >= NB_PLAYLIST_MODES) {
+		return "unknown";
+	}
+	return MODE_NAMES[mode];
+}
+
+int parse_playlist_mode(const char *name)
+{
+	return sysfs_match_string(MODE_NAMES, name);
+}
+
+void set_playlist_mode(struct playlist *playlist, enum playlist_mode mode,
+		       struct stat_spinlock *playlist_lock)
+{
+	unsigned long irq_flags;
+
+	stat_spin_lock_irqsave(playlist_lock, irq_flags);
+	playlist->mode = mode;
+	stat_spin_unlock_irqrestore(playlist_lock, irq_flags);
+	pr_info("[%s]: Mode set to %s\n", LIB_NAME, playlist_mode_name(mode));
+}
+
+bool playlist_has_space(struct playlist *playlist)
+{
+	return get_playlist_memory(playlist) < READ_ONCE(playlist->budget);
+}
+
+int set_music_to_playlist(struct playlist *playlist, struct song *song,
+			  struct stat_spinlock *playlist_lock)
+{
+	struct song_ring *target;
+	struct song_ring *ring;
+	struct song_ring *new_ring = NULL;
+	struct song *new_songs = NULL;
+	unsigned int new_capacity = 0;
+	unsigned int capacity;
+	unsigned long irq_flags;
 
 	if (!is_initilized_playlist(playlist)) {
 		pr_err("[%s]: Playlist is not initialized\n", LIB_NAME);
 		return -EINVAL;
 	}
 
-	if (music == NULL) {
+	if (song == NULL) {
 		pr_err("[%s]: Music is NULL\n", LIB_NAME);
 		return -EINVAL;
 	}
@@ -42,30 +232,109 @@ int set_music_to_playlist(struct kfifo *playlist, struct music *music,
 		return -EINVAL;
 	}
 
-	nb_elements = kfifo_len(playlist) / sizeof(struct music);
+	stat_spin_lock_irqsave(playlist_lock, irq_flags);
+	/// a ring too small is replaced by a bigger one allocated outside of
+	/// the lock, the check is done again because the playlist may have
+	/// changed meanwhile
+	for (;;) {
+		target = playlist->mode == PLAYLIST_PRIORITY ?
+				 &playlist->priority :
+				 &playlist->queue;
+		ring = ring_to_grow(playlist, target, &capacity);
+		if (!ring) {
+			break;
+		}
+		if (new_songs && new_ring == ring && new_capacity >= capacity) {
+			// the old array is freed with the next allocation
+			new_songs = swap_ring(ring, new_songs, new_capacity);
+			new_ring = NULL;
+			continue;
+		}
+		stat_spin_unlock_irqrestore(playlist_lock, irq_flags);
 
-	if (nb_elements >= PLAYLIST_SIZE) {
-		pr_err("[%s]: Playlist is full\n", LIB_NAME);
-		return -ENOSPC;
+		kvfree(new_songs);
+		new_ring = ring;
+		new_capacity = capacity;
+		new_songs = kvmalloc_array(new_capacity, sizeof(struct song),
+					   GFP_KERNEL);
+		if (!new_songs) {
+			pr_err("[%s]: The music could not be added to the playlist\n",
+			       LIB_NAME);
+			return -ENOMEM;
+		}
+		stat_spin_lock_irqsave(playlist_lock, irq_flags);
 	}
 
-	ret = kfifo_in_spinlocked(playlist, music, sizeof(struct music),
-				  playlist_lock);
+	push_song(playlist, target, song);
+	stat_spin_unlock_irqrestore(playlist_lock, irq_flags);
 
-	if (ret != sizeof(struct music)) {
-		pr_err("[%s]: The music could not be added to the playlist\n",
-		       LIB_NAME);
-		return -ENOSPC;
-	}
+	// either an unused array or the old one after a swap
+	kvfree(new_songs);
 
-	pr_info("[%s]: Music added to playlist: Title [%s] Artiste [%s] Duration [%d]\n",
-		LIB_NAME, music->name, music->artist, music->duration);
+	pr_debug("[%s]: Music added to playlist: Title [%s] Artiste [%s] Duration [%d]\n",
+		 LIB_NAME, song_name(song), song_artist(song), song->duration);
 	return 0;
 }
 
-int get_music_from_playlist(struct kfifo *playlist, struct music *music,
-			    spinlock_t *playlist_lock)
+int get_music_from_playlist_locked(struct playlist *playlist,
+				   struct song *song)
+{
+	if (playlist->priority.nb_songs > 0) {
+		pop_song(playlist, &playlist->priority, song);
+		return 0;
+	}
+	if (playlist->queue.nb_songs > 0) {
+		pop_song(playlist, &playlist->queue, song);
+		return 0;
+	}
+	return -ENODATA;
+}
+
+int get_next_music_locked(struct playlist *playlist, struct song *current,
+			  bool skip, struct song *next)
+{
+	struct song_ring *queue = &playlist->queue;
+	unsigned int index;
+
+	switch (playlist->mode) {
+	case PLAYLIST_REPEAT_ONE:
+		if (current->duration == 0 || skip) {
+			break;
+		}
+		*next = *current;
+		get_song(next);
+		return 0;
+
+	case PLAYLIST_REPEAT_ALL:
+		/// the queue always has room for the current song, see
+		/// ring_to_grow
+		if (current->duration != 0) {
+			push_song(playlist, queue, current);
+			get_song(current);
+		}
+		break;
+
+	case PLAYLIST_SHUFFLE:
+		/// each track change draws the next element of a random
+		/// permutation of the queue: a random song is swapped with the
+		/// first one (Fisher-Yates), the priority songs still go first
+		if (playlist->priority.nb_songs == 0 && queue->nb_songs > 1) {
+			index = get_random_u32() % queue->nb_songs;
+			swap(*song_at(queue, 0), *song_at(queue, index));
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return get_music_from_playlist_locked(playlist, next);
+}
+
+int get_music_from_playlist(struct playlist *playlist, struct song *song,
+			    struct stat_spinlock *playlist_lock)
 {
+	unsigned long irq_flags;
 	int ret;
 
 	if (!is_initilized_playlist(playlist)) {
@@ -73,20 +342,137 @@ int get_music_from_playlist(struct kfifo *playlist, struct music *music,
 		return -EINVAL;
 	}
 
-	if (music == NULL) {
+	if (song == NULL) {
 		pr_err("[%s]: Musici to filll is NULL\n", LIB_NAME);
 		return -EINVAL;
 	}
 
-	ret = kfifo_out_spinlocked(playlist, music, sizeof(struct music),
-				   playlist_lock);
+	stat_spin_lock_irqsave(playlist_lock, irq_flags);
+	ret = get_music_from_playlist_locked(playlist, song);
+	stat_spin_unlock_irqrestore(playlist_lock, irq_flags);
 
-	if (ret != sizeof(struct music)) {
+	if (ret) {
 		pr_err("[%s]: The music could not be retrieved from the playlist\n",
 		       LIB_NAME);
-		return -ENODATA;
+		return ret;
 	}
 
-	pr_info("[%s]: Music retrieved from playlist\n", LIB_NAME);
+	pr_debug("[%s]: Music retrieved from playlist\n", LIB_NAME);
 	return 0;
 }
+
+int get_musics_from_playlist(struct playlist *playlist, struct song *songs,
+			     int max_songs, struct stat_spinlock *playlist_lock)
+{
+	unsigned long irq_flags;
+	int nb_songs;
+
+	if (!is_initilized_playlist(playlist)) {
+		pr_err("[%s]: Playlist is not initialized\n", LIB_NAME);
+		return -EINVAL;
+	}
+
+	if (songs == NULL || playlist_lock == NULL) {
+		pr_err("[%s]: Songs or playlist lock is NULL\n", LIB_NAME);
+		return -EINVAL;
+	}
+
+	/// the copies get their own references before the lock is released,
+	/// otherwise the player could release the strings meanwhile
+	stat_spin_lock_irqsave(playlist_lock, irq_flags);
+	nb_songs = min_t(int, max_songs, playlist->nb_songs);
+	for (int i = 0; i < nb_songs; i++) {
+		songs[i] = *playlist_song_at(playlist, i);
+		get_song(&songs[i]);
+	}
+	stat_spin_unlock_irqrestore(playlist_lock, irq_flags);
+
+	return nb_songs;
+}
+
+uint32_t get_playlist_duration(struct playlist *playlist,
+			       struct stat_spinlock *playlist_lock)
+{
+	unsigned long irq_flags;
+	uint32_t total_duration = 0;
+
+	stat_spin_lock_irqsave(playlist_lock, irq_flags);
+	for (unsigned int i = 0; i < playlist->nb_songs; i++) {
+		total_duration += playlist_song_at(playlist, i)->duration;
+	}
+	stat_spin_unlock_irqrestore(playlist_lock, irq_flags);
+
+	return total_duration;
+}
+
+int replace_playlist(struct playlist *playlist, struct song *songs,
+		     int nb_songs, struct stat_spinlock *playlist_lock)
+{
+	struct song_ring queue;
+	struct song_ring priority;
+	struct song_ring old_queue;
+	struct song_ring old_priority;
+	unsigned long irq_flags;
+
+	if (!is_initilized_playlist(playlist)) {
+		pr_err("[%s]: Playlist is not initialized\n", LIB_NAME);
+		return -EINVAL;
+	}
+
+	if ((songs == NULL && nb_songs > 0) || playlist_lock == NULL) {
+		pr_err("[%s]: Songs or playlist lock is NULL\n", LIB_NAME);
+		return -EINVAL;
+	}
+
+	if (alloc_ring(&queue, roundup_pow_of_two(max_t(
+				       unsigned int, nb_songs + 2,
+				       PLAYLIST_MIN_CAPACITY)))) {
+		return -ENOMEM;
+	}
+	if (alloc_ring(&priority, PLAYLIST_MIN_CAPACITY)) {
+		kvfree(queue.songs);
+		return -ENOMEM;
+	}
+	memcpy(queue.songs, songs, nb_songs * sizeof(struct song));
+	queue.nb_songs = nb_songs;
+
+	stat_spin_lock_irqsave(playlist_lock, irq_flags);
+	old_queue = playlist->queue;
+	old_priority = playlist->priority;
+	playlist->queue = queue;
+	playlist->priority = priority;
+	WRITE_ONCE(playlist->nb_songs, nb_songs);
+	stat_spin_unlock_irqrestore(playlist_lock, irq_flags);
+
+	/// the replaced songs are released once the lock is released
+	for (unsigned int i = 0; i < old_priority.nb_songs; i++) {
+		release_song(playlist->pool, song_at(&old_priority, i));
+	}
+	for (unsigned int i = 0; i < old_queue.nb_songs; i++) {
+		release_song(playlist->pool, song_at(&old_queue, i));
+	}
+	kvfree(old_priority.songs);
+	kvfree(old_queue.songs);
+	wake_up_interruptible(&playlist->space_wait_queue);
+
+	pr_info("[%s]: Playlist replaced by %d musics\n", LIB_NAME, nb_songs);
+	return 0;
+}
+
+void clear_playlist(struct playlist *playlist,
+		     struct stat_spinlock *playlist_lock)
+{
+	struct song song;
+	unsigned long irq_flags;
+	int ret;
+
+	do {
+		stat_spin_lock_irqsave(playlist_lock, irq_flags);
+		ret = get_music_from_playlist_locked(playlist, &song);
+		stat_spin_unlock_irqrestore(playlist_lock, irq_flags);
+		if (ret == 0) {
+			release_song(playlist->pool, &song);
+		}
+	} while (ret == 0);
+	wake_up_interruptible(&playlist->space_wait_queue);
+}
@@ -1,28 +1,178 @@
+#ifndef PLAYLIST_H
+#define PLAYLIST_H
+
 #include <linux/init.h>
-#include <linux/kfifo.h>
-#include "music.h"
-#define PLAYLIST_SIZE 16
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include "song.h"
+#include "lock_stats.h"
+#define PLAYLIST_MIN_CAPACITY 16 // must be a power of 2
+#define PLAYLIST_DEFAULT_BUDGET (1024 * 1024)
 
 #define STR_HELPER(x) #x
 #define STR(x) STR_HELPER(x)
 
+///@brief the order in which the songs of a playlist are played
+enum playlist_mode {
+	PLAYLIST_FIFO, // in the order they were added
+	PLAYLIST_REPEAT_ONE, // the current song is played again
+	PLAYLIST_REPEAT_ALL, // the current song is added back at the end
+	PLAYLIST_SHUFFLE, // a random song of the queue
+	PLAYLIST_PRIORITY, // as FIFO but added songs are played first
+	NB_PLAYLIST_MODES,
+};
+
+///@brief a growable ring of songs
+///@note the ring grows by doubling its capacity
+struct song_ring {
+	struct song *songs; // ring of capacity songs
+	unsigned int capacity; // always a power of 2
+	unsigned int first; // index of the first song of the ring
+	unsigned int nb_songs;
+};
+
+///@brief a queue of songs, the number of songs is only limited by the memory
+/// budget
+///@note the songs added in priority mode are kept in their own ring and played
+/// before the others, every policy takes the next song in O(1)
+struct playlist {
+	struct song_ring queue;
+	struct song_ring priority;
+	unsigned int nb_songs; // songs of both rings
+	enum playlist_mode mode;
+	size_t budget; // memory allowed for the songs and the strings
+	struct str_pool *pool; // pool of the strings of the songs
+	wait_queue_head_t space_wait_queue; // writers waiting for memory
+};
+
+/// @brief Initialize a playlist
+/// @param playlist The playlist to initialize
+/// @param pool The pool of the strings of the songs
+/// @return 0 if no error
+int init_playlist(struct playlist *playlist, struct str_pool *pool);
+
+/// @brief Release all the songs of a playlist and free its ring
+/// @param playlist The playlist to free
+/// @param playlist_lock The lock of the playlist
+void free_playlist(struct playlist *playlist,
+		    struct stat_spinlock *playlist_lock);
+
 /// @brief Check if the playlist is initialized
 /// @param playlist The playlist to check
 /// @return true if the playlist is initialized, false otherwise
-bool is_initilized_playlist(struct kfifo *playlist);
+bool is_initilized_playlist(struct playlist *playlist);
+
+/// @brief Get the number of songs of a playlist
+/// @param playlist The playlist
+/// @return the number of songs
+/// @note the value is read without lock, it can be outdated as soon as it is returned
+unsigned int get_playlist_len(struct playlist *playlist);
+
+/// @brief Get the memory used by the songs of a playlist and their strings
+/// @param playlist The playlist
+/// @return the number of bytes used, the free slots of the rings are not
+/// counted
+size_t get_playlist_memory(struct playlist *playlist);
+
+/// @brief Set the memory budget of a playlist
+/// @param playlist The playlist
+/// @param budget The number of bytes allowed
+void set_playlist_budget(struct playlist *playlist, size_t budget);
+
+/// @brief Get the name of a playlist mode
+/// @param mode The mode
+/// @return the name of the mode, as accepted by parse_playlist_mode
+const char *playlist_mode_name(enum playlist_mode mode);
+
+/// @brief Parse the name of a playlist mode
+/// @param name The name, a trailing new line is ignored
+/// @return the mode or -EINVAL
+int parse_playlist_mode(const char *name);
+
+/// @brief Set the mode of a playlist
+/// @param playlist The playlist
+/// @param mode The new mode
+/// @param playlist_lock The lock of the playlist
+/// @note the songs already added in priority mode are still played first
+void set_playlist_mode(struct playlist *playlist, enum playlist_mode mode,
+		       struct stat_spinlock *playlist_lock);
+
+/// @brief Check if a song can be added to a playlist without exceeding its budget
+/// @param playlist The playlist
+/// @return true if a song can be added
+bool playlist_has_space(struct playlist *playlist);
 
 /// @brief Set a music to a playlist
 /// @param playlist The playlist to fill
 /// @return 0 if no error
-/// @param music The music to add
+/// @param song The song to add, the playlist takes its references on success
+/// @note the ring may grow then this method may sleep
 /// @note in this method a spinlock is used to protect the playlist, the irq will be saved and restored
-int set_music_to_playlist(struct kfifo *playlist, struct music *music,
-			  spinlock_t *playlist_lock);
+int set_music_to_playlist(struct playlist *playlist, struct song *song,
+			  struct stat_spinlock *playlist_lock);
 
 /// @brief Get a music from a playlist
 /// @param playlist The playlist to get the music from
-/// @param music The music to fill
+/// @param song The song to fill, the caller takes its references
 /// @return 0 if no error
 /// @note in this method a spinlock is used to protect the playlist, the irq will be saved and restored
-int get_music_from_playlist(struct kfifo *playlist, struct music *music,
-			    spinlock_t *playlist_lock);
+int get_music_from_playlist(struct playlist *playlist, struct song *song,
+			    struct stat_spinlock *playlist_lock);
+
+/// @brief Get a music from a playlist whose lock is already held
+/// @param playlist The playlist to get the music from
+/// @param song The song to fill, the caller takes its references
+/// @return 0 if no error, -ENODATA if the playlist is empty
+/// @note the songs are returned in order whatever the mode of the playlist
+int get_music_from_playlist_locked(struct playlist *playlist,
+				   struct song *song);
+
+/// @brief Get the song to play after the current one according to the mode
+/// of the playlist, the lock must be held
+/// @param playlist The playlist
+/// @param current The song being played, its duration is 0 if none
+/// @param skip true if the user skips the current song, then repeat-one
+/// plays the next song of the queue
+/// @param next The song to fill, the caller takes its references
+/// @return 0 if no error, -ENODATA if there is no next song
+/// @note the references of current are left to the caller
+/// @note this method never allocates, it runs in O(1)
+int get_next_music_locked(struct playlist *playlist, struct song *current,
+			  bool skip, struct song *next);
+
+/// @brief Copy the musics of a playlist without removing them
+/// @param playlist The playlist to copy
+/// @param songs The buffer to fill in play order, the caller must release each song
+/// @param max_songs The number of songs the buffer can hold
+/// @param playlist_lock The lock of the playlist
+/// @return the number of songs copied or a negative error code
+/// @note in this method a spinlock is used to protect the playlist, the irq will be saved and restored
+int get_musics_from_playlist(struct playlist *playlist, struct song *songs,
+			     int max_songs, struct stat_spinlock *playlist_lock);
+
+/// @brief Get the sum of the durations of the songs of a playlist
+/// @param playlist The playlist
+/// @param playlist_lock The lock of the playlist
+/// @return the total duration in seconds
+/// @note in this method a spinlock is used to protect the playlist, the irq will be saved and restored
+uint32_t get_playlist_duration(struct playlist *playlist,
+			       struct stat_spinlock *playlist_lock);
+
+/// @brief Replace all the musics of a playlist
+/// @param playlist The playlist to fill
+/// @param songs The new songs, the playlist takes their references on success
+/// @param nb_songs The number of new songs
+/// @param playlist_lock The lock of the playlist
+/// @return 0 if no error, the playlist is left untouched on error
+/// @note the new songs are all queued as normal songs
+/// @note in this method a spinlock is used to protect the playlist, the irq will be saved and restored
+int replace_playlist(struct playlist *playlist, struct song *songs,
+		     int nb_songs, struct stat_spinlock *playlist_lock);
+
+/// @brief Release all the musics of a playlist
+/// @param playlist The playlist to empty
+/// @param playlist_lock The lock of the playlist
+void clear_playlist(struct playlist *playlist,
+		     struct stat_spinlock *playlist_lock);
+
+#endif // PLAYLIST_H
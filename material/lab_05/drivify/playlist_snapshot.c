@@ -0,0 +1,134 @@
+#include "drivify_ioctl.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define USAGE "Usage: %s save|load <file>\n"
+#define DEVICE_NAME "/dev/drivify"
+
+/// @brief Save the playlist of the device in a file
+/// @param fd the device
+/// @param path the file to write
+/// @return EXIT_SUCCESS if no error
+static int save(int fd, const char *path)
+{
+	struct drivify_snapshot snapshot = { 0 };
+	void *blob = NULL;
+	FILE *file;
+
+	// the first call only gets the size of the snapshot, the playlist can
+	// grow between two calls then it is retried
+	while (ioctl(fd, DRIVIFY_IOC_EXPORT, &snapshot) < 0) {
+		if (errno != ENOSPC) {
+			perror("Failed to export the playlist");
+			free(blob);
+			return EXIT_FAILURE;
+		}
+		free(blob);
+		blob = malloc(snapshot.size);
+		if (!blob) {
+			perror("Failed to allocate the snapshot");
+			return EXIT_FAILURE;
+		}
+		snapshot.addr = (uintptr_t)blob;
+	}
+
+	file = fopen(path, "wb");
+	if (!file) {
+		perror("Failed to open the file");
+		free(blob);
+		return EXIT_FAILURE;
+	}
+
+	if (fwrite(blob, 1, snapshot.size, file) != snapshot.size) {
+		perror("Failed to write the file");
+		fclose(file);
+		free(blob);
+		return EXIT_FAILURE;
+	}
+
+	printf("Playlist saved in %s (%u bytes)\n", path, snapshot.size);
+	fclose(file);
+	free(blob);
+	return EXIT_SUCCESS;
+}
+
+/// @brief Load a playlist in the device from a file
+/// @param fd the device
+/// @param path the file to read
+/// @return EXIT_SUCCESS if no error
+static int load(int fd, const char *path)
+{
+	struct drivify_snapshot snapshot = { 0 };
+	struct stat file_stat;
+	void *blob;
+	FILE *file;
+
+	file = fopen(path, "rb");
+	if (!file) {
+		perror("Failed to open the file");
+		return EXIT_FAILURE;
+	}
+
+	if (fstat(fileno(file), &file_stat) < 0 ||
+	    file_stat.st_size > SNAPSHOT_MAX_SIZE) {
+		fprintf(stderr, "Invalid snapshot file\n");
+		fclose(file);
+		return EXIT_FAILURE;
+	}
+
+	blob = malloc(file_stat.st_size);
+	if (!blob ||
+	    fread(blob, 1, file_stat.st_size, file) != (size_t)file_stat.st_size) {
+		perror("Failed to read the file");
+		fclose(file);
+		free(blob);
+		return EXIT_FAILURE;
+	}
+	fclose(file);
+
+	snapshot.addr = (uintptr_t)blob;
+	snapshot.size = file_stat.st_size;
+	if (ioctl(fd, DRIVIFY_IOC_IMPORT, &snapshot) < 0) {
+		perror("Failed to import the playlist, please check dmesg");
+		free(blob);
+		return EXIT_FAILURE;
+	}
+
+	printf("Playlist loaded from %s\n", path);
+	free(blob);
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret;
+	int fd;
+
+	if (argc != 3) {
+		fprintf(stderr, USAGE, argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	fd = open(DEVICE_NAME, O_RDWR);
+	if (fd < 0) {
+		perror("Failed to open device");
+		return EXIT_FAILURE;
+	}
+
+	if (strcmp(argv[1], "save") == 0) {
+		ret = save(fd, argv[2]);
+	} else if (strcmp(argv[1], "load") == 0) {
+		ret = load(fd, argv[2]);
+	} else {
+		fprintf(stderr, USAGE, argv[0]);
+		ret = EXIT_FAILURE;
+	}
+
+	close(fd);
+	return ret;
+}
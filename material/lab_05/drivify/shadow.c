@@ -0,0 +1,38 @@
+#include "shadow.h"
+#include <linux/io.h>
+#include <linux/printk.h>
+
+#define LIB_NAME "shadow"
+
+void init_shadow_reg(struct shadow_reg *shadow, void __iomem *reg)
+{
+	shadow->reg = reg;
+	if (!reg) {
+		pr_err("[%s]: Register is not initialized\n", LIB_NAME);
+		shadow->value = 0;
+		shadow->flushed = 0;
+		return;
+	}
+	shadow->flushed = ioread32(reg);
+	shadow->value = shadow->flushed;
+}
+
+bool shadow_flush(struct shadow_reg *shadow)
+{
+	if (shadow->value == shadow->flushed || !shadow->reg) {
+		return false;
+	}
+	iowrite32(shadow->value, shadow->reg);
+	shadow->flushed = shadow->value;
+	return true;
+}
+
+void shadow_write(struct shadow_reg *shadow, uint32_t value)
+{
+	shadow->value = value;
+	if (!shadow->reg) {
+		return;
+	}
+	iowrite32(value, shadow->reg);
+	shadow->flushed = value;
+}
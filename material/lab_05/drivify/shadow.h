@@ -0,0 +1,49 @@
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include <linux/types.h>
+
+/// @brief In memory copy of an output register
+/// @note the desired value is built in memory and written to the register
+/// only when it differs from the last written value
+/// @note a shadow register has a single writer, it is not protected by a lock
+struct shadow_reg {
+	void __iomem *reg;
+	uint32_t value; // desired value
+	uint32_t flushed; // value of the register after the last flush
+};
+
+/// @brief Initialize a shadow register from the current hardware value
+/// @param shadow the shadow register to initialize
+/// @param reg the register to shadow
+void init_shadow_reg(struct shadow_reg *shadow, void __iomem *reg);
+
+/// @brief Set the desired value of a shadow register
+/// @param shadow the shadow register
+/// @param value the new value
+static inline void shadow_set(struct shadow_reg *shadow, uint32_t value)
+{
+	shadow->value = value;
+}
+
+/// @brief Change some bits of the desired value of a shadow register
+/// @param shadow the shadow register
+/// @param mask the bits to change
+/// @param bits the new value of the bits of the mask
+static inline void shadow_update(struct shadow_reg *shadow, uint32_t mask,
+				 uint32_t bits)
+{
+	shadow->value = (shadow->value & ~mask) | (bits & mask);
+}
+
+/// @brief Write the desired value to the register if it changed
+/// @param shadow the shadow register
+/// @return true if the register was written
+bool shadow_flush(struct shadow_reg *shadow);
+
+/// @brief Set and write a value to the register whatever its last value
+/// @param shadow the shadow register
+/// @param value the new value
+void shadow_write(struct shadow_reg *shadow, uint32_t value);
+
+#endif // SHADOW_H
@@ -0,0 +1,199 @@
+#include "snapshot.h"
+#include "player.h"
+#include "playlist.h"
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#define LIB_NAME "snapshot"
+
+/// @brief Release an array of songs
+/// @param pool the pool of the strings
+/// @param songs the songs
+/// @param nb_songs the number of songs to release
+static void release_songs(struct str_pool *pool, struct song *songs,
+			  int nb_songs)
+{
+	for (int i = 0; i < nb_songs; i++) {
+		release_song(pool, &songs[i]);
+	}
+	kvfree(songs);
+}
+
+int build_snapshot(struct player *player, void **blob, size_t *size)
+{
+	struct snapshot_header header;
+	struct song *songs;
+	uint32_t position;
+	size_t total_size;
+	size_t offset;
+	int max_songs;
+	int nb_songs;
+	int state;
+	int first;
+
+	// the first slot is for the current song
+	// songs added meanwhile are left out of the snapshot
+	max_songs = get_playlist_len(player->playlist) + 1;
+	songs = kvmalloc_array(max_songs, sizeof(struct song), GFP_KERNEL);
+	if (!songs) {
+		return -ENOMEM;
+	}
+
+	get_current_song(player, &songs[0]);
+	get_current_duration(player, &position);
+	state = get_player_state(player);
+	nb_songs = get_musics_from_playlist(player->playlist, &songs[1],
+					    max_songs - 1,
+					    &player->queue_lock);
+	if (nb_songs < 0) {
+		release_songs(&player->pool, songs, 1);
+		return nb_songs;
+	}
+	nb_songs++;
+
+	// without current song the entries start at the second slot
+	first = songs[0].duration == 0 ? 1 : 0;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = SNAPSHOT_MAGIC;
+	header.version = SNAPSHOT_VERSION;
+	header.header_size = sizeof(header);
+	header.nb_songs = nb_songs - first;
+	header.has_current = first == 0;
+	header.position = first == 0 ? position : 0;
+	header.state = state == 1;
+
+	total_size = sizeof(header);
+	for (int i = first; i < nb_songs; i++) {
+		total_size += song_record_size(&songs[i]);
+	}
+
+	// the budget can exceed what an import accepts, such a snapshot could
+	// never be loaded back
+	if (total_size > SNAPSHOT_MAX_SIZE) {
+		pr_err("[%s]: Snapshot of %zu bytes exceeds the maximum of %d bytes\n",
+		       LIB_NAME, total_size, SNAPSHOT_MAX_SIZE);
+		release_songs(&player->pool, songs, nb_songs);
+		return -E2BIG;
+	}
+	header.total_size = total_size;
+
+	*blob = kvmalloc(header.total_size, GFP_KERNEL);
+	if (!*blob) {
+		release_songs(&player->pool, songs, nb_songs);
+		return -ENOMEM;
+	}
+
+	memcpy(*blob, &header, sizeof(header));
+	offset = sizeof(header);
+	for (int i = first; i < nb_songs; i++) {
+		offset += song_to_record(&songs[i], (uint8_t *)*blob + offset);
+	}
+	*size = header.total_size;
+
+	release_songs(&player->pool, songs, nb_songs);
+	return 0;
+}
+
+int restore_snapshot(struct player *player, const void *blob, size_t size)
+{
+	struct snapshot_header header;
+	struct song *songs;
+	const uint8_t *src;
+	size_t offset;
+	ssize_t ret;
+	int first;
+	int err;
+
+	if (size < sizeof(header)) {
+		pr_err("[%s]: Snapshot too small\n", LIB_NAME);
+		return -EINVAL;
+	}
+	memcpy(&header, blob, sizeof(header));
+
+	if (header.magic != SNAPSHOT_MAGIC ||
+	    header.version != SNAPSHOT_VERSION) {
+		pr_err("[%s]: Unknown snapshot format\n", LIB_NAME);
+		return -EINVAL;
+	}
+
+	if (header.header_size < sizeof(header) ||
+	    header.header_size > header.total_size ||
+	    header.total_size > size || header.has_current > 1 ||
+	    header.nb_songs < header.has_current) {
+		pr_err("[%s]: Invalid snapshot header\n", LIB_NAME);
+		return -EINVAL;
+	}
+
+	// each entry holds at least its header, this bounds the allocation
+	if (header.nb_songs > (header.total_size - header.header_size) /
+				      sizeof(struct music)) {
+		pr_err("[%s]: Invalid number of songs\n", LIB_NAME);
+		return -EINVAL;
+	}
+
+	// the records bound the size of their strings once interned
+	if (header.nb_songs * sizeof(struct song) + header.total_size >
+	    READ_ONCE(player->playlist->budget)) {
+		pr_err("[%s]: Snapshot exceeds the playlist budget\n",
+		       LIB_NAME);
+		return -ENOSPC;
+	}
+
+	songs = kvmalloc_array(max_t(uint32_t, header.nb_songs, 1),
+			       sizeof(struct song), GFP_KERNEL);
+	if (!songs) {
+		return -ENOMEM;
+	}
+
+	src = blob;
+	offset = header.header_size;
+	for (uint32_t i = 0; i < header.nb_songs; i++) {
+		ret = song_from_record(&player->pool, src + offset,
+				       header.total_size - offset, &songs[i]);
+		if (ret < 0) {
+			pr_err("[%s]: Invalid entry %u\n", LIB_NAME, i);
+			release_songs(&player->pool, songs, i);
+			return ret;
+		}
+		offset += ret;
+	}
+
+	if (header.has_current && header.position > songs[0].duration) {
+		pr_err("[%s]: Invalid position\n", LIB_NAME);
+		release_songs(&player->pool, songs, header.nb_songs);
+		return -EINVAL;
+	}
+
+	first = header.has_current ? 1 : 0;
+	err = replace_playlist(player->playlist, &songs[first],
+			       header.nb_songs - first, &player->queue_lock);
+	if (err) {
+		release_songs(&player->pool, songs, header.nb_songs);
+		return err;
+	}
+
+	/// the songs are now owned by the player
+	err = set_current_song(player, header.has_current ? &songs[0] : NULL,
+			       header.position);
+	if (err) {
+		// the playlist is already replaced, only the current song is
+		// still owned here
+		if (header.has_current) {
+			release_song(&player->pool, &songs[0]);
+		}
+		kvfree(songs);
+		return -EINVAL;
+	}
+	if (header.state) {
+		do_play(player);
+	} else {
+		do_pause(player);
+	}
+
+	pr_info("[%s]: %u songs restored\n", LIB_NAME, header.nb_songs);
+	kvfree(songs);
+	return 0;
+}
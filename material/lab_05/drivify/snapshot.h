@@ -0,0 +1,21 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "drivify_shared_types.h"
+#include "drivify_ioctl.h"
+
+/// @brief Build a snapshot of the playlist, the current song and its position
+/// @param player the player to snapshot
+/// @param blob set to the snapshot, it must be freed with kvfree
+/// @param size set to the size of the snapshot
+/// @return 0 if no error
+int build_snapshot(struct player *player, void **blob, size_t *size);
+
+/// @brief Restore a snapshot built by build_snapshot
+/// @param player the player to restore
+/// @param blob the snapshot
+/// @param size the size of the snapshot
+/// @return 0 if no error, the player is left untouched if the snapshot is invalid
+int restore_snapshot(struct player *player, const void *blob, size_t size);
+
+#endif // SNAPSHOT_H
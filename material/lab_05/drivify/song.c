@@ -0,0 +1,85 @@
+#include "song.h"
+#include <linux/kernel.h>
+#include <linux/string.h>
+
+void clear_song(struct song *song)
+{
+	song->name = NULL;
+	song->artist = NULL;
+	song->duration = 0;
+}
+
+ssize_t song_from_record(struct str_pool *pool, const void *record,
+			 size_t size, struct song *song)
+{
+	struct music header;
+	const char *strings;
+	size_t record_size;
+
+	if (size < sizeof(header)) {
+		return -EINVAL;
+	}
+	memcpy(&header, record, sizeof(header));
+
+	record_size = music_record_size(&header);
+	if (size < record_size || header.duration == 0 ||
+	    header.name_len == 0 || header.artist_len == 0) {
+		return -EINVAL;
+	}
+
+	strings = (const char *)record + sizeof(header);
+	song->name = intern_str(pool, strings, header.name_len);
+	song->artist = intern_str(pool, strings + header.name_len,
+				  header.artist_len);
+	if (!song->name || !song->artist) {
+		release_song(pool, song);
+		return -ENOMEM;
+	}
+	song->duration = header.duration;
+
+	return record_size;
+}
+
+size_t song_record_size(const struct song *song)
+{
+	return sizeof(struct music) + (song->name ? song->name->len : 0) +
+	       (song->artist ? song->artist->len : 0);
+}
+
+size_t song_to_record(const struct song *song, void *dest)
+{
+	struct music header;
+	uint8_t *strings;
+
+	header.duration = song->duration;
+	header.name_len = song->name ? song->name->len : 0;
+	header.artist_len = song->artist ? song->artist->len : 0;
+
+	memcpy(dest, &header, sizeof(header));
+	strings = (uint8_t *)dest + sizeof(header);
+	memcpy(strings, song_name(song), header.name_len);
+	memcpy(strings + header.name_len, song_artist(song), header.artist_len);
+
+	return music_record_size(&header);
+}
+
+void get_song(struct song *song)
+{
+	if (song->name) {
+		get_str(song->name);
+	}
+	if (song->artist) {
+		get_str(song->artist);
+	}
+}
+
+void release_song(struct str_pool *pool, struct song *song)
+{
+	if (song->name) {
+		put_str(pool, song->name);
+	}
+	if (song->artist) {
+		put_str(pool, song->artist);
+	}
+	clear_song(song);
+}
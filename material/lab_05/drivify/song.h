@@ -0,0 +1,65 @@
+#ifndef SONG_H
+#define SONG_H
+
+#include "music.h"
+#include "strpool.h"
+
+///@brief a song as stored by the player, its strings are handles in a pool
+///@note a song owns a reference on each of its strings
+struct song {
+	struct pool_str *name;
+	struct pool_str *artist;
+	uint32_t duration;
+};
+
+/// @brief Get the title of a song
+/// @param song the song
+/// @return the title, empty if the song has none
+static inline const char *song_name(const struct song *song)
+{
+	return song->name ? song->name->str : "";
+}
+
+/// @brief Get the artist of a song
+/// @param song the song
+/// @return the artist, empty if the song has none
+static inline const char *song_artist(const struct song *song)
+{
+	return song->artist ? song->artist->str : "";
+}
+
+/// @brief Reset a song to an empty song without string
+/// @param song the song to clear, its references are not released
+void clear_song(struct song *song);
+
+/// @brief Create a song from a music record
+/// @param pool the pool of the strings
+/// @param record the music record followed by its strings
+/// @param size the number of bytes available from the record
+/// @param song the song to fill
+/// @return the size of the record or a negative error code
+/// @note this method may sleep
+ssize_t song_from_record(struct str_pool *pool, const void *record,
+			 size_t size, struct song *song);
+
+/// @brief Get the size of the music record of a song
+/// @param song the song
+/// @return the size of the record and its strings
+size_t song_record_size(const struct song *song);
+
+/// @brief Write the music record of a song
+/// @param song the song
+/// @param dest where to write, song_record_size bytes must be available
+/// @return the number of bytes written
+size_t song_to_record(const struct song *song, void *dest);
+
+/// @brief Get one more reference on the strings of a song
+/// @param song the song
+void get_song(struct song *song);
+
+/// @brief Release the strings of a song and clear it
+/// @param pool the pool of the strings
+/// @param song the song
+void release_song(struct str_pool *pool, struct song *song);
+
+#endif // SONG_H
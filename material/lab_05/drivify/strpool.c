@@ -0,0 +1,116 @@
+#include "strpool.h"
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/stringhash.h>
+
+#define LIB_NAME "strpool"
+
+/// @brief Find a string in the pool
+/// @param pool the pool, its lock must be held
+/// @param str the string
+/// @param len the length of the string
+/// @param hash the hash of the string
+/// @return the interned string or NULL if not found
+static struct pool_str *find_str(struct str_pool *pool, const char *str,
+				 uint8_t len, uint32_t hash)
+{
+	struct pool_str *entry;
+
+	hash_for_each_possible(pool->table, entry, node, hash) {
+		if (entry->hash == hash && entry->len == len &&
+		    memcmp(entry->str, str, len) == 0) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+void init_str_pool(struct str_pool *pool)
+{
+	hash_init(pool->table);
+	spin_lock_init(&pool->lock);
+	pool->nb_strings = 0;
+	pool->nb_bytes = 0;
+}
+
+void destroy_str_pool(struct str_pool *pool)
+{
+	if (pool->nb_strings != 0) {
+		pr_err("[%s]: %u strings are still in use\n", LIB_NAME,
+		       pool->nb_strings);
+	}
+}
+
+struct pool_str *intern_str(struct str_pool *pool, const char *str,
+			    uint8_t len)
+{
+	struct pool_str *entry;
+	struct pool_str *new_entry;
+	unsigned long irq_flags;
+	uint32_t hash;
+
+	hash = full_name_hash(NULL, str, len);
+
+	spin_lock_irqsave(&pool->lock, irq_flags);
+	entry = find_str(pool, str, len, hash);
+	if (entry) {
+		refcount_inc(&entry->refs);
+	}
+	spin_unlock_irqrestore(&pool->lock, irq_flags);
+	if (entry) {
+		return entry;
+	}
+
+	/// the allocation is done outside of the lock, then the string may
+	/// have been added by someone else meanwhile
+	new_entry = kmalloc(sizeof(struct pool_str) + len + 1, GFP_KERNEL);
+	if (!new_entry) {
+		return NULL;
+	}
+	refcount_set(&new_entry->refs, 1);
+	new_entry->hash = hash;
+	new_entry->len = len;
+	memcpy(new_entry->str, str, len);
+	new_entry->str[len] = '\0';
+
+	spin_lock_irqsave(&pool->lock, irq_flags);
+	entry = find_str(pool, str, len, hash);
+	if (entry) {
+		refcount_inc(&entry->refs);
+	} else {
+		hash_add(pool->table, &new_entry->node, hash);
+		pool->nb_strings++;
+		pool->nb_bytes += ksize(new_entry);
+	}
+	spin_unlock_irqrestore(&pool->lock, irq_flags);
+
+	if (entry) {
+		kfree(new_entry);
+		return entry;
+	}
+	return new_entry;
+}
+
+void get_str(struct pool_str *str)
+{
+	refcount_inc(&str->refs);
+}
+
+void put_str(struct str_pool *pool, struct pool_str *str)
+{
+	unsigned long irq_flags;
+
+	/// the count only drops to zero with the lock held, then a string
+	/// found in the table always has a reference
+	if (!refcount_dec_and_lock_irqsave(&str->refs, &pool->lock,
+					   &irq_flags)) {
+		return;
+	}
+	hash_del(&str->node);
+	pool->nb_strings--;
+	pool->nb_bytes -= ksize(str);
+	spin_unlock_irqrestore(&pool->lock, irq_flags);
+
+	kfree(str);
+}
@@ -0,0 +1,55 @@
+#ifndef STRPOOL_H
+#define STRPOOL_H
+
+#include <linux/hashtable.h>
+#include <linux/refcount.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+#define STR_POOL_BITS 8
+
+///@brief a string interned in a pool, shared by all its users
+struct pool_str {
+	struct hlist_node node;
+	refcount_t refs;
+	uint32_t hash;
+	uint8_t len;
+	char str[]; // null terminated
+};
+
+///@brief a pool of reference counted strings where each string is stored once
+struct str_pool {
+	DECLARE_HASHTABLE(table, STR_POOL_BITS);
+	spinlock_t lock;
+	unsigned int nb_strings;
+	size_t nb_bytes; // memory used by the strings and their headers
+};
+
+/// @brief Initialize a string pool
+/// @param pool the pool to initialize
+void init_str_pool(struct str_pool *pool);
+
+/// @brief Destroy a string pool
+/// @param pool the pool to destroy, all its strings must have been released
+void destroy_str_pool(struct str_pool *pool);
+
+/// @brief Get a reference on a string, it is added to the pool if needed
+/// @param pool the pool
+/// @param str the string, it does not need to be null terminated
+/// @param len the length of the string
+/// @return the interned string or NULL if the allocation failed
+/// @note this method may sleep, a spinlock is used to protect the pool
+struct pool_str *intern_str(struct str_pool *pool, const char *str,
+			    uint8_t len);
+
+/// @brief Get one more reference on an interned string
+/// @param str the string
+void get_str(struct pool_str *str);
+
+/// @brief Release a reference on an interned string
+/// @param pool the pool of the string
+/// @param str the string, it is freed with its last reference
+/// @note in this method a spinlock is used to protect the pool, the irq will be saved and restored
+void put_str(struct str_pool *pool, struct pool_str *str);
+
+#endif // STRPOOL_H